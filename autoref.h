@@ -11,6 +11,7 @@
 #include "ssl_referee.pb.h"
 
 #include "base_ref.h"
+#include "event_pipeline.h"
 
 #include "constants.h"
 #include "events.h"
@@ -19,11 +20,36 @@
 
 using namespace google::protobuf;
 
+// the events, in the order they are processed
+using AutorefEvents = EventPipeline<InitEvent,
+                                    RobotsStartedEvent,
+                                    KickReadyEvent,  // must be before anything that can transition
+                                                     // from game-on to game-off, so it doesn't miss
+                                                     // any transitions and can always reset properly
+                                    BallSpeedEvent,
+                                    BallStuckEvent,
+                                    GoalScoredEvent,
+                                    BallExitEvent,
+                                    DelayDoneEvent,
+                                    KickTakenEvent,
+                                    KickExpiredEvent,
+                                    BallTouchedEvent,
+                                    LongDribbleEvent,
+                                    StageTimeEndedEvent>;
+
 class Autoref : public BaseAutoref
 {
+  AutorefEvents pipeline;
+
   bool doEvents(const World &w, bool ball_z_valid = false, float ball_z = 0);
   bool verbose;
 
 public:
   Autoref(bool verbose_);
+
+  template <typename E>
+  E &event()
+  {
+    return pipeline.get<E>();
+  }
 };
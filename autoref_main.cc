@@ -1,19 +1,28 @@
 #include <fcntl.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/signalfd.h>
 
-#include <sys/select.h>
+#include <unistd.h>
 
 #include "autoref.h"
 #include "base_ref.h"
+#include "batch.h"
 #include "eval_ref.h"
+#include "ingest.h"
 
 #include "constants.h"
+#include "flight_log.h"
+#include "latency.h"
 #include "messages_robocup_ssl_wrapper.pb.h"
 #include "optionparser.h"
 #include "rconclient.h"
+#include "reactor.h"
+#include "replay.h"
 #include "ssl_referee.pb.h"
 #include "udp.h"
+#include "util.h"
 
 enum OptionIndex
 {
@@ -24,6 +33,34 @@ enum OptionIndex
   ACTIVE,
   DIVB,
   NOCONSENSUS,
+  RECORD,
+  RECORD_SEGMENTS,
+  REPLAY,
+  BATCH,
+  JOBS,
+  FROM,
+  BEFORE,
+  DURATION,
+  MARKS,
+  PARTIAL,
+  CAMERA_TIMEOUT,
+  RULE_THREADS,
+  STATS,
+  STATS_INTERVAL,
+};
+
+struct Arg : public option::Arg
+{
+  static option::ArgStatus Required(const option::Option &opt, bool msg)
+  {
+    if (opt.arg != nullptr && opt.arg[0] != 0) {
+      return option::ARG_OK;
+    }
+    if (msg) {
+      fprintf(stderr, "Option '%.*s' requires an argument\n", opt.namelen, opt.name);
+    }
+    return option::ARG_ILLEGAL;
+  }
 };
 
 const option::Descriptor options[] = {
@@ -34,6 +71,57 @@ const option::Descriptor options[] = {
   {ACTIVE, 0, "a", "active", option::Arg::None, "-a, --active: send refbox control messages by default"},
   {DIVB, 0, "b", "divb", option::Arg::None, "-b, --divb: set to division B (default A)"},
   {NOCONSENSUS, 0, "n", "nocon", option::Arg::None, "-n, --nocon: send to refbox instead of consensus"},
+  {PARTIAL,
+   0,
+   "p",
+   "partial",
+   option::Arg::None,
+   "-p, --partial: update the world after every camera frame instead of waiting for all cameras"},
+  {CAMERA_TIMEOUT,
+   0,
+   "",
+   "camera-timeout",
+   Arg::Required,
+   "--camera-timeout <seconds>: drop a camera that has sent nothing for this long (default: 0.5)"},
+  {RULE_THREADS,
+   0,
+   "",
+   "rule-threads",
+   Arg::Required,
+   "--rule-threads <n>: process the independent rules on <n> extra threads, with the same results (default: 0)"},
+  {STATS,
+   0,
+   "",
+   "stats",
+   option::Arg::None,
+   "--stats: print how long parsing, tracking, each event and refbox sends take (p50/p99/p999), periodically and "
+   "on exit"},
+  {STATS_INTERVAL,
+   0,
+   "",
+   "stats-interval",
+   Arg::Required,
+   "--stats-interval <seconds>: how often --stats prints while running live (default: 10)"},
+  {RECORD, 0, "r", "record", Arg::Required, "-r, --record <prefix>: record all received packets to <prefix>.NNNNNN.arlog"},
+  {RECORD_SEGMENTS,
+   0,
+   "",
+   "record-segments",
+   Arg::Required,
+   "--record-segments <n>: keep only the newest <n> segments of the --record log (default: all)"},
+  {REPLAY, 0, "", "replay", Arg::Required, "--replay <log>: run a recorded log through the autoref as fast as possible"},
+  {FROM,
+   0,
+   "",
+   "from",
+   Arg::Required,
+   "--from <point>: start --replay at <seconds> into the log, stage:<STAGE>, command:<COMMAND> or event:<text>, "
+   "optionally with #<n> for the nth occurrence"},
+  {BEFORE, 0, "", "before", Arg::Required, "--before <seconds>: start --replay this long before the --from point"},
+  {DURATION, 0, "", "duration", Arg::Required, "--duration <seconds>: stop --replay after this long"},
+  {MARKS, 0, "", "marks", Arg::Required, "--marks <log>: list the stage changes, commands and events in a log"},
+  {BATCH, 0, "", "batch", option::Arg::None, "--batch <log>...: re-referee several recorded logs in parallel and print a report"},
+  {JOBS, 0, "j", "jobs", Arg::Required, "-j, --jobs <n>: number of worker threads for --batch (default: one per core)"},
   {0, 0, nullptr, nullptr, nullptr, nullptr},
 };
 
@@ -51,28 +139,27 @@ int main(int argc, char *argv[])
     return 0;
   }
 
-  UDP vision_net;
-  if (!vision_net.open(VisionGroup, VisionPort, true)) {
-    puts("SSL-Vision port open failed!");
-    exit(1);
-  }
-
-  UDP ref_net;
-  if (!ref_net.open(RefGroup, RefPort, false)) {
-    puts("Referee port open failed!");
-    exit(1);
+  if (args[MARKS]) {
+    if (!PrintLogIndex(args[MARKS].arg, stdout)) {
+      printf("Could not open log %s!\n", args[MARKS].arg);
+      return 1;
+    }
+    return 0;
   }
 
-  bool active = args[ACTIVE] != nullptr;
-  RemoteClient rcon;
-  bool rcon_opened = false;
+  if (args[BATCH]) {
+    std::vector<std::string> logs(parse.nonOptions(), parse.nonOptions() + parse.nonOptionsCount());
+    if (logs.empty()) {
+      puts("No logs given!");
+      return 1;
+    }
+    int jobs = args[JOBS] ? atoi(args[JOBS].arg) : 0;
 
-  if (rcon.open("localhost", args[NOCONSENSUS] ? RefboxPort : ConsensusPort)) {
-    puts("Remote client opened!");
-    rcon_opened = true;
-  }
-  else {
-    puts("Remote client port open failed!");
+    uint64_t start = GetTimeMicros();
+    std::vector<MatchResult> results =
+      EvaluateBatch(logs, args[FULL] != nullptr, args[DIVB] != nullptr, args[PARTIAL] != nullptr, jobs);
+    PrintBatchReport(results, (GetTimeMicros() - start) / 1e6, stdout);
+    return 0;
   }
 
   bool verbose = (args[VERBOSE] != nullptr);
@@ -93,65 +180,285 @@ int main(int argc, char *argv[])
     Constants::initDivisionA();
   }
 
-  SSL_WrapperPacket vision_msg;
-  SSL_Referee ref_msg;
+  if (args[PARTIAL]) {
+    puts("Updating the world after every camera frame.");
+    autoref->tracker.setPartialUpdates(true);
+  }
+  if (args[CAMERA_TIMEOUT]) {
+    autoref->tracker.setCameraTimeout(atof(args[CAMERA_TIMEOUT].arg));
+  }
+  if (args[RULE_THREADS]) {
+    autoref->setRuleThreads(atoi(args[RULE_THREADS].arg));
+  }
+
+  if (args[REPLAY]) {
+    ReplayOptions ro;
+    if (args[FROM]) {
+      ro.from = args[FROM].arg;
+    }
+    if (args[BEFORE]) {
+      ro.before = atof(args[BEFORE].arg);
+    }
+    if (args[DURATION]) {
+      ro.duration = atof(args[DURATION].arg);
+    }
+
+    ReplayStats rs;
+    if (!ReplayLog(args[REPLAY].arg, *autoref, rs, ro)) {
+      printf("Could not open log %s!\n", args[REPLAY].arg);
+      return 1;
+    }
+    printf("\nReplayed %lu packets (%lu vision, %lu referee, %lu unparseable)\n",
+           rs.packets,
+           rs.vision_packets,
+           rs.referee_packets,
+           rs.parse_errors);
+    printf("%lu frames and %lu deadline runs, %lu refbox requests\n", rs.frames, rs.ticks, rs.decisions);
+    printf("%.1f s of match in %.3f s: %.0f frames/s (%.1fx real time)\n",
+           rs.match_time,
+           rs.wall_time,
+           rs.wall_time > 0 ? rs.frames / rs.wall_time : 0,
+           rs.wall_time > 0 ? rs.match_time / rs.wall_time : 0);
+    if (rs.latency_count > 0) {
+      printf("recv-to-decision latency: mean %.2f ms, max %.2f ms\n",
+             1000 * rs.latency_sum / rs.latency_count,
+             1000 * rs.latency_max);
+    }
+    printf("%.2f of %zu events dispatched per frame\n",
+           (rs.frames + rs.ticks) > 0 ? static_cast<double>(autoref->dispatchCount()) / (rs.frames + rs.ticks) : 0,
+           autoref->eventCount());
+    printf("%d cameras at the end, %u joins, %u drops\n",
+           autoref->tracker.numCameras(),
+           autoref->tracker.cameraJoins(),
+           autoref->tracker.cameraDrops());
+    if (args[STATS]) {
+      putchar('\n');
+      PrintLatencyHeader(stdout);
+      PrintLatency(stdout, "parse", rs.parse_latency);
+      autoref->printLatency(stdout);
+    }
+    return 0;
+  }
+
+  Ingest ingest;
+  if (!ingest.openVision()) {
+    puts("SSL-Vision port open failed!");
+    exit(1);
+  }
+  if (!ingest.openReferee()) {
+    puts("Referee port open failed!");
+    exit(1);
+  }
+
+  FlightRecorder recorder;
+  if (args[RECORD]) {
+    int max_segments = args[RECORD_SEGMENTS] ? atoi(args[RECORD_SEGMENTS].arg) : 0;
+    if (!recorder.open(args[RECORD].arg, FlightRecorder::DefaultSegmentSize, max_segments)) {
+      puts("Flight recorder open failed!");
+      exit(1);
+    }
+    printf("Recording to %s\n", FlightRecorder::segmentName(args[RECORD].arg, recorder.sequence()).c_str());
+    ingest.setRecorder(&recorder);
+    autoref->setFiredListener([&](const AutorefEvent *ev, const World &w) { ingest.markEvent(ev->name(), w.time); });
+  }
+
+  bool active = args[ACTIVE] != nullptr;
+  RemoteClient rcon;
+  bool rcon_opened = false;
+
+  if (rcon.open("localhost", args[NOCONSENSUS] ? RefboxPort : ConsensusPort, true)) {
+    puts("Remote client opened!");
+    rcon_opened = true;
+  }
+  else {
+    puts("Remote client port open failed!");
+  }
 
-  fd_set read_fds;
-  int n_fds = std::max(vision_net.getFd(), ref_net.getFd()) + 1;
+  Reactor reactor;
+  if (!reactor.isOpen()) {
+    puts("Event loop setup failed!");
+    exit(1);
+  }
 
   bool got_vision = false, got_ref = false;
+  uint64_t last_overflows = 0;
 
-  puts("\nWaiting for network packets...");
-  printf("\n\n\n\n\x1b[35;1mAutoref is now %s. Press enter to toggle.\x1b[m\n", active ? "ACTIVE" : "PASSIVE");
+  bool print_stats = args[STATS] != nullptr;
+  double stats_interval = args[STATS_INTERVAL] ? atof(args[STATS_INTERVAL].arg) : 10;
+  auto printStats = [&]() {
+    putchar('\n');
+    PrintLatencyHeader(stdout);
+    PrintLatency(stdout, "parse", ingest.parseLatency());
+    autoref->printLatency(stdout);
+    PrintLatency(stdout, "refbox send", rcon.sendLatency());
+    rcon.printDecisionLatency(stdout);
+  };
 
-  int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-  fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+  // requests to the refbox are pipelined: queued here, written when the
+  // socket is writable and matched to their replies by message ID
+  auto updateRconEvents = [&]() {
+    if (rcon.isOpen()) {
+      reactor.modify(rcon.getFd(), EPOLLIN | (rcon.wantsWrite() ? uint32_t(EPOLLOUT) : 0u));
+    }
+  };
+  if (rcon_opened) {
+    reactor.add(rcon.getFd(), EPOLLIN, [&](uint32_t events) {
+      int fd = rcon.getFd();
+      bool ok = true;
+      if (events & EPOLLOUT) {
+        ok = rcon.onWritable();
+      }
+      if (ok && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        ok = rcon.onReadable();
+      }
+      if (!ok) {
+        puts("Remote client connection lost!");
+        reactor.remove(fd);
+        rcon_opened = false;
+        return;
+      }
+      updateRconEvents();
+    });
+  }
+
+  // send the remote control request produced by the last run of the events,
+  // if any; since is when the input that led to it arrived
+  auto sendRemote = [&](double since) {
+    //// currently, we're not sending actual referee messages
+    // if (autoref->isMessageReady()) {
+    //   ref_net.send(autoref->makeMessage(), ref_addr);
+    // }
 
-  while (true) {
-    FD_ZERO(&read_fds);
-    FD_SET(vision_net.getFd(), &read_fds);
-    FD_SET(ref_net.getFd(), &read_fds);
-    FD_SET(STDIN_FILENO, &read_fds);
-    select(n_fds, &read_fds, nullptr, nullptr, nullptr);
+    if (autoref->isRemoteReady()) {
+      if (verbose) {
+        printf("decision latency: %.3f ms\n", (GetTimeMicros() / 1e6 - since) * 1000);
+      }
+      if (active && rcon_opened) {
+        RequestTag tag(autoref->decisionEvent(), autoref->decisionCaptureTime(), GetTimeMicros() / 1e6);
+        // taken first, since a failure closes the socket
+        int fd = rcon.getFd();
+        if (rcon.queueRequest(autoref->makeRemote(), tag) && rcon.onWritable()) {
+          updateRconEvents();
+        }
+        else {
+          puts("Remote client connection lost!");
+          reactor.remove(fd);
+          rcon_opened = false;
+        }
+      }
+    }
+  };
+
+  reactor.add(ingest.getFd(), EPOLLIN, [&](uint32_t) {
+    ingest.clearNotify();
+
+    // drain everything the ingest thread has parsed before running the
+    // events, so a whole burst of camera packets is handled at once
+    double first_arrival = 0;
+    for (IngestPacket *p = ingest.front(); p != nullptr; ingest.pop(), p = ingest.front()) {
+      if (p->source == IngestPacket::REFEREE) {
+        if (!got_ref) {
+          got_ref = true;
+          puts("Got ref packet!");
+        }
+        autoref->updateReferee(*p->referee, p->content_hash);
+        continue;
+      }
 
-    if (FD_ISSET(vision_net.getFd(), &read_fds) && vision_net.recv(vision_msg)) {
       if (!got_vision) {
         got_vision = true;
         puts("Got vision packet!");
       }
 
+      const SSL_WrapperPacket &vision_msg = *p->vision;
       if (vision_msg.has_detection()) {
-        autoref->updateVision(vision_msg.detection());
-
-        //// currently, we're not sending actual referee messages
-        // if (autoref->isMessageReady()) {
-        //   ref_net.send(autoref->makeMessage(), ref_addr);
-        // }
-
-        if (autoref->isRemoteReady()) {
-          if (active && rcon_opened) {
-            rcon.sendRequest(autoref->makeRemote());
-          }
+        autoref->addVision(vision_msg.detection());
+        if (first_arrival == 0) {
+          first_arrival = p->recv_time;
         }
       }
-      if (vision_msg.has_geometry()) {
+      if (vision_msg.has_geometry() && autoref->updateGeometry(vision_msg.geometry(), p->content_hash)) {
         Constants::updateGeometry(vision_msg.geometry());
-        autoref->updateGeometry(vision_msg.geometry());
       }
     }
-    if (FD_ISSET(ref_net.getFd(), &read_fds) && ref_net.recv(ref_msg)) {
-      if (!got_ref) {
-        got_ref = true;
-        puts("Got ref packet!");
-      }
-      autoref->updateReferee(ref_msg);
+
+    if (first_arrival > 0) {
+      autoref->step();
+      sendRemote(first_arrival);
+      reactor.setDeadline(autoref->nextWakeTime());
     }
-    if (FD_ISSET(STDIN_FILENO, &read_fds)) {
-      active = !active;
-      printf("\x1b[35;1mAutoref is now %s. Press enter to toggle.\x1b[m\n", active ? "ACTIVE" : "PASSIVE");
-      char buf[100];
-      while (read(STDIN_FILENO, buf, sizeof(buf)) > 0) {
-      }
+
+    if (ingest.overflowCount() != last_overflows) {
+      last_overflows = ingest.overflowCount();
+      printf("\x1b[31;1mIngest ring overflowed: %lu packets dropped (high water %d/%d)\x1b[m\n",
+             last_overflows,
+             ingest.highWater(),
+             ingest.capacity());
+    }
+  });
+
+  // time-driven events (kick deadline, end of stage, delays) run here when
+  // their deadline passes without a vision frame having triggered them
+  reactor.onDeadline([&]() {
+    double now = GetTimeMicros() / 1e6;
+    if (autoref->tick(now)) {
+      sendRemote(now);
+    }
+    reactor.setDeadline(autoref->nextWakeTime());
+  });
+
+  // on its own timer, so that the stats keep coming when vision stops
+  if (print_stats && stats_interval > 0 && !reactor.addPeriodic(stats_interval, printStats)) {
+    puts("Stats timer setup failed!");
+  }
+
+  reactor.add(STDIN_FILENO, EPOLLIN, [&](uint32_t) {
+    active = !active;
+    printf("\x1b[35;1mAutoref is now %s. Press enter to toggle.\x1b[m\n", active ? "ACTIVE" : "PASSIVE");
+    char buf[100];
+    while (read(STDIN_FILENO, buf, sizeof(buf)) > 0) {
     }
+  });
+
+  // stop cleanly on SIGINT/SIGTERM so that the recording gets its footers
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &stop_signals, nullptr);
+  int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  bool running = true;
+  reactor.add(signal_fd, EPOLLIN, [&](uint32_t) { running = false; });
+
+  puts("\nWaiting for network packets...");
+  printf("\n\n\n\n\x1b[35;1mAutoref is now %s. Press enter to toggle.\x1b[m\n", active ? "ACTIVE" : "PASSIVE");
+
+  int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
+  fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+
+  // calibrate the cycle counter now rather than in the middle of the match
+  CyclesPerNs();
+
+  ingest.start();
+
+  while (running && reactor.runOnce()) {
+  }
+
+  ingest.stop();
+  if (print_stats) {
+    printStats();
+  }
+  else {
+    rcon.printDecisionLatency(stdout);
+  }
+  if (recorder.isOpen()) {
+    printf("Recorded %lu packets (%lu dropped).\n", recorder.recordCount(), recorder.droppedCount());
+    recorder.close();
+  }
+
+  if (running) {
+    puts("Event loop failed!");
+    return 1;
   }
+  return 0;
 }
@@ -1,42 +1,225 @@
 #include <cstdio>
 #include <ctime>
+#include <stdexcept>
 
 #include "autoref.h"
 #include "events.h"
 
-BaseAutoref::BaseAutoref() : log(nullptr), message_ready(false), state_updated(false)
+BaseAutoref::BaseAutoref()
+    : log(nullptr),
+      out(stdout),
+      decision_event(nullptr),
+      decision_time(0),
+      all_events(0),
+      dispatch_mask(0),
+      dispatch_count(0),
+      static_dispatch(true),
+      message_ready(false),
+      state_updated(false),
+      clock_offset(0),
+      capture_clock(false),
+      deadline_tick(false),
+      last_time(0)
 {
   have_geometry = new_refbox = false;
+  geometry_hash = refbox_hash = 0;
   game_on = false;
   new_stage = new_cmd = false;
   cmd_counter = 0;
+
+  for (auto &stage_masks : dispatch_masks) {
+    for (uint64_t &m : stage_masks) {
+      m = 0;
+    }
+  }
+}
+
+void BaseAutoref::registerEvent(AutorefEvent *ev, const char *id)
+{
+  event_map[id] = ev;
+  addDispatch(ev, events.size());
+  events.push_back(ev);
+  event_latency.emplace_back();
+}
+
+void BaseAutoref::addDispatch(const AutorefEvent *ev, int index)
+{
+  if (index >= 64) {
+    throw std::length_error("too many events for the dispatch masks");
+  }
+  all_events |= uint64_t(1) << index;
+
+  uint32_t states = ev->activeStates(), stages = ev->activeStages();
+  for (int state = 0; state < NUM_REF_STATES; state++) {
+    for (int stage = 0; stage < SSL_Referee::Stage_ARRAYSIZE; stage++) {
+      if ((states >> state & 1) && (stages >> stage & 1)) {
+        dispatch_masks[state][stage] |= uint64_t(1) << index;
+      }
+    }
+  }
 }
 
-void BaseAutoref::updateGeometry(const SSL_GeometryData &g)
+void BaseAutoref::updateDispatch()
 {
+  // (all events if the state or stage is out of range)
+  uint64_t mask = all_events;
+  if (vars.state >= 0 && vars.state < NUM_REF_STATES && vars.stage >= 0 && vars.stage < SSL_Referee::Stage_ARRAYSIZE) {
+    mask = dispatch_masks[vars.state][vars.stage];
+  }
+
+  if (mask != dispatch_mask) {
+    for (uint64_t leaving = dispatch_mask & ~mask; leaving != 0; leaving &= leaving - 1) {
+      events[__builtin_ctzll(leaving)]->suspend();
+    }
+    dispatch_mask = mask;
+  }
+}
+
+void BaseAutoref::setRuleThreads(int threads)
+{
+  rule_pool.reset(threads > 0 ? new WorkPool(threads) : nullptr);
+}
+
+void BaseAutoref::awaitSpeculation(int i)
+{
+  while (!speculation_done[i].load(std::memory_order_acquire)) {
+    if (!rule_pool->runOne()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+int BaseAutoref::nextEvent(int i)
+{
+  updateDispatch();
+  uint64_t rest = (i < 0) ? dispatch_mask : dispatch_mask & ~((uint64_t(2) << i) - 1);
+  return rest ? __builtin_ctzll(rest) : -1;
+}
+
+bool BaseAutoref::updateGeometry(const SSL_GeometryData &g, uint64_t hash)
+{
+  if (have_geometry && hash != 0 && hash == geometry_hash) {
+    return false;
+  }
   if (!have_geometry) {
-    puts("got geometry!");
+    fputs("got geometry!\n", out);
   }
   have_geometry = true;
+  geometry_hash = hash;
   geometry.CopyFrom(g);
+  return true;
 }
 
 void BaseAutoref::updateVision(const SSL_DetectionFrame &d)
 {
+  addVision(d);
+  step();
+}
+
+void BaseAutoref::addVision(const SSL_DetectionFrame &d)
+{
+  LatencyProbe probe(tracker_latency);
   tracker.updateVision(d);
+}
+
+void BaseAutoref::printLatency(FILE *f) const
+{
+  PrintLatency(f, "tracker update", tracker_latency);
+  for (size_t i = 0; i < events.size(); i++) {
+    PrintLatency(f, events[i]->name(), event_latency[i]);
+  }
+}
+
+bool BaseAutoref::step()
+{
   World w;
-  if (have_geometry && tracker.getWorld(w)) {
+  if (tracker.popWorld(w) && have_geometry) {
+    world_history.add(w);
+    world_features.reset(&world_history[0]);
+    if (w.ball.visible()) {
+      ball_fit.add(w.time, w.ball.loc);
+    }
+    while (ball_fit.size() > 0 && ball_fit[-ball_fit.size() + 1].t < world_history.time(-world_history.size() + 1)) {
+      ball_fit.removeOldest();
+    }
+    last_time = w.time;
+    if (!capture_clock) {
+      clock_offset = GetTimeMicros() / 1e6 - w.time;
+    }
+
     doEvents(w);
+    return true;
   }
-  else {
-    message_ready = false;
+  message_ready = false;
+  return false;
+}
+
+double BaseAutoref::nextWakeTime() const
+{
+  if (world_history.empty()) {
+    return 0;
+  }
+
+  // deadlines at or before the last processed time have had their chance
+  double next = 0;
+  for (const AutorefEvent *ev : events) {
+    double t = ev->nextDeadline();
+    if (t > last_time && (next == 0 || t < next)) {
+      next = t;
+    }
   }
+  return (next > 0) ? next + clock_offset : 0;
 }
 
-void BaseAutoref::updateReferee(const SSL_Referee &r)
+bool BaseAutoref::tick(double now)
+{
+  if (world_history.empty() || !have_geometry) {
+    return false;
+  }
+
+  double t = now - clock_offset;
+  if (t <= last_time) {
+    return false;
+  }
+
+  bool due = false;
+  for (const AutorefEvent *ev : events) {
+    double d = ev->nextDeadline();
+    if (d > last_time && d <= t) {
+      due = true;
+    }
+  }
+  if (!due) {
+    return false;
+  }
+
+  World w = world_history[0];
+  w.time = t;
+  last_time = t;
+
+  deadline_tick = true;
+  doEvents(w);
+  deadline_tick = false;
+  return true;
+}
+
+void BaseAutoref::updateReferee(const SSL_Referee &r, uint64_t hash)
 {
   new_refbox = true;
-  refbox_message = r;
+  if (hash != 0 && hash == refbox_hash) {
+    // only the per-packet fields differ
+    refbox_message.set_packet_timestamp(r.packet_timestamp());
+    if (r.has_stage_time_left()) {
+      refbox_message.set_stage_time_left(r.stage_time_left());
+    }
+    else {
+      refbox_message.clear_stage_time_left();
+    }
+  }
+  else {
+    refbox_hash = hash;
+    refbox_message = r;
+  }
   vars.blue_side = r.blue_team_on_positive_half() ? 1 : -1;
 }
 
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdio>
 
 #include <algorithm>
+#include <atomic>
 #include <deque>
+#include <functional>
 #include <map>
+#include <memory>
+#include <type_traits>
 
 #include <google/protobuf/text_format.h>
 
@@ -14,9 +19,15 @@
 #include "ssl_referee.pb.h"
 
 #include "constants.h"
+#include "event_pipeline.h"
 #include "events.h"
+#include "latency.h"
+#include "linear_fit.h"
+#include "world_features.h"
 #include "touches.h"
 #include "tracker.h"
+#include "work_pool.h"
+#include "world_history.h"
 
 using namespace google::protobuf;
 
@@ -25,16 +36,70 @@ class BaseAutoref
 protected:
   ostream *log;
 
+  // where fired events and other messages are printed
+  FILE *out;
+
+  // number of times each event has newly fired, by name
+  std::map<std::string, int> fired_counts;
+
+  std::function<void(const AutorefEvent *, const World &)> fired_listener;
+
+  // the event that last newly fired, and the time of the world it fired on
+  const char *decision_event;
+  double decision_time;
+
+  // to be called by doEvents for each event that newly fires
+  void noteFired(const AutorefEvent *ev, const World &w)
+  {
+    decision_event = ev->name();
+    decision_time = w.time;
+    fired_counts[ev->name()]++;
+    if (fired_listener) {
+      fired_listener(ev, w);
+    }
+  }
+
   bool have_geometry, new_refbox;
   SSL_GeometryData geometry;
   SSL_Referee refbox_message;
 
+  // content hashes of the stored geometry and referee message (0 if unknown)
+  uint64_t geometry_hash, refbox_hash;
+
   bool game_on;
 
   friend class AutorefEvent;
   std::vector<AutorefEvent *> events;
   std::map<const char *, AutorefEvent *> event_map;
 
+  // for each state and stage, bit i set if events[i] is dispatched then
+  uint64_t dispatch_masks[NUM_REF_STATES][SSL_Referee::Stage_ARRAYSIZE];
+  uint64_t all_events;
+
+  // the events being dispatched for the current vars, and the number of
+  // process() calls made
+  uint64_t dispatch_mask;
+  uint64_t dispatch_count;
+
+  // if set (the default), runEvents calls the events through their pipeline
+  // rather than through the vtable
+  bool static_dispatch;
+
+  // brings dispatch_mask up to date with the current vars, suspending the
+  // events that stop being dispatched
+  void updateDispatch();
+
+  // the index of the next event after i (or from the start, if i is -1) to
+  // process for the current vars, or -1 if there are none
+  int nextEvent(int i);
+
+  // whether events[i] is to be processed for the current vars
+  bool dispatching(int i)
+  {
+    updateDispatch();
+    return (dispatch_mask >> i) & 1;
+  }
+
   vector2f ball_reset_loc;
 
   uint32_t cmd_counter;
@@ -45,18 +110,186 @@ protected:
   SSL_Referee_Game_Event game_event;
   bool message_ready;
 
-  template <typename E>
-  void addEvent()
+  // registers the events of an EventPipeline (which must outlive this) in
+  // order, so that events[i] is its i-th event
+  template <typename Pipeline>
+  void addEvents(Pipeline &pipeline)
+  {
+    pipeline.forEach([this](auto &ev) { registerEvent(&ev, &std::decay_t<decltype(ev)>::ID); });
+  }
+  void registerEvent(AutorefEvent *ev, const char *id);
+  void addDispatch(const AutorefEvent *ev, int index);
+
+  // processes the events that apply for the current vars, in order, calling
+  // after(ev) following each one; stops and returns true as soon as after
+  // does (e.g. to start over once an event has changed the vars)
+  template <typename Pipeline, typename After>
+  bool runEvents(Pipeline &pipeline, const World &w, bool ball_z_valid, float ball_z, After after)
+  {
+    if (!static_dispatch) {
+      for (int i = nextEvent(-1); i >= 0; i = nextEvent(i)) {
+        AutorefEvent *ev = events[i];
+        if (skipEvent(ev, w)) {
+          continue;
+        }
+        {
+          LatencyProbe probe(event_latency[i]);
+          ev->process(w, ball_z_valid, ball_z);
+        }
+        dispatch_count++;
+        printNotes(ev);
+        if (after(ev)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // the Independent events are started on rule_pool, against the vars as
+    // they are now, and taken in order as the others are processed here. The
+    // engines only change vars when an event newly fires, so until then
+    // each result is what processing the event here would have given; once
+    // one fires, the events still out are rolled back and processed here.
+    uint64_t pending = (rule_pool && !deadline_tick) ? speculate(pipeline, w, ball_z_valid, ball_z) : 0;
+
+    // when the event being processed here started (0 if it was not)
+    uint64_t start = 0;
+
+    bool stopped = pipeline.run(
+      w,
+      ball_z_valid,
+      ball_z,
+      [&](int i) {
+        if ((pending >> i) & 1) {
+          pending &= ~(uint64_t(1) << i);
+          awaitSpeculation(i);
+          start = 0;
+          return EVENT_PROCESSED;
+        }
+        if (!dispatching(i) || skipEvent(events[i], w)) {
+          return SKIP_EVENT;
+        }
+        start = CycleCount();
+        return PROCESS_EVENT;
+      },
+      [&](int i, AutorefEvent *ev) {
+        if (start != 0) {
+          event_latency[i].record(CycleCount() - start);
+        }
+        dispatch_count++;
+        if (pending != 0 && ev->firingNew()) {
+          cancelSpeculation(pipeline, pending);
+          pending = 0;
+        }
+        printNotes(ev);
+        return after(ev);
+      });
+    cancelSpeculation(pipeline, pending);
+    if (!stopped) {
+      updateDispatch();
+    }
+    return stopped;
+  }
+
+  // time taken by each process() call on events[i], and by each tracker
+  // update; event_latency[i] is only recorded by one thread at a time
+  std::deque<LatencyHistogram> event_latency;
+  LatencyHistogram tracker_latency;
+
+  // with more than 0 rule threads, the Independent events are processed on
+  // them, alongside the other events, when a vision frame comes in
+  std::unique_ptr<WorkPool> rule_pool;
+  AutorefVariables speculation_vars;
+  Constants::Values speculation_constants;
+  std::atomic<bool> speculation_done[64];
+
+  // starts the Independent events that are dispatched for the current vars
+  // on rule_pool; returns them as a mask
+  template <typename Pipeline>
+  uint64_t speculate(Pipeline &pipeline, const World &w, bool ball_z_valid, float ball_z)
+  {
+    updateDispatch();
+    speculation_vars = vars;
+    speculation_constants = Constants::get();
+    world_features.computeAll();
+    return pipeline.speculate(
+      speculation_vars,
+      w,
+      ball_z_valid,
+      ball_z,
+      [this](int i) { return (dispatch_mask >> i) & 1; },
+      [this](int i, auto task) {
+        speculation_done[i].store(false, std::memory_order_relaxed);
+        rule_pool->submit([this, i, task]() {
+          Constants::set(speculation_constants);
+          {
+            LatencyProbe probe(event_latency[i]);
+            task();
+          }
+          speculation_done[i].store(true, std::memory_order_release);
+        });
+      });
+  }
+
+  // waits for the speculate task of events[i] (helping with the others)
+  void awaitSpeculation(int i);
+
+  // waits for the events in pending and puts them back as they were
+  template <typename Pipeline>
+  void cancelSpeculation(Pipeline &pipeline, uint64_t pending)
+  {
+    for (; pending != 0; pending &= pending - 1) {
+      int i = __builtin_ctzll(pending);
+      awaitSpeculation(i);
+      pipeline.restore(i);
+    }
+  }
+
+  void printNotes(const AutorefEvent *ev)
   {
-    E *ev = new E(this);
-    event_map[&E::ID] = ev;
-    events.push_back(ev);
+    if (!ev->getNotes().empty()) {
+      fputs(ev->getNotes().c_str(), out);
+    }
   }
 
   bool new_stage, new_cmd;
 
   bool state_updated;
 
+  // the worlds from the most recent frames; added to before the events run
+  // on each frame (but not on deadline ticks). The newest is also the world
+  // that deadline ticks rerun, and the wall clock minus its capture time is
+  // clock_offset, for running deadline-driven events between vision frames.
+  WorldHistory world_history;
+  double clock_offset;
+
+  // the ball's locations in the most recent worlds in world_history (up to
+  // 5) in which it was visible, fitted for the events that extrapolate it
+  // while it is not
+  LinearFit<5> ball_fit;
+
+  // geometry derived from the newest world, shared by the events; computed
+  // as the events ask for it, except that speculate() computes all of it at
+  // once so that rule threads only read it
+  WorldFeatures world_features;
+
+  // if set, clock_offset stays 0, so deadlines are given and ticked in
+  // capture time (for replaying logs without wall-clock pacing)
+  bool capture_clock;
+
+  // set while tick() runs the events; only events with a deadline that has
+  // passed are processed then
+  bool deadline_tick;
+
+  bool skipEvent(const AutorefEvent *ev, const World &w) const
+  {
+    if (!deadline_tick) {
+      return false;
+    }
+    double t = ev->nextDeadline();
+    return t <= 0 || t > w.time;
+  }
+
   virtual bool doEvents(const World &w, bool ball_z_valid = false, float ball_z = 0) = 0;
 
 public:
@@ -85,6 +318,7 @@ public:
 
   int NumBlueRobots, NumYellowRobots;
 
+  // (looked up at run time; the engines' event<E>() resolves at compile time)
   template <typename E>
   E *getEvent() const
   {
@@ -108,9 +342,94 @@ public:
   SSL_Referee makeMessage();
   SSL_RefereeRemoteControlRequest makeRemote();
 
-  void updateGeometry(const SSL_GeometryData &g);
+  // what makeRemote's request is for: the name of the event that last newly
+  // fired (nullptr if none has), and the capture time of the frame it fired
+  // on (for events that fire on a deadline, the deadline)
+  const char *decisionEvent() const
+  {
+    return decision_event;
+  }
+  double decisionCaptureTime() const
+  {
+    return decision_time;
+  }
+
+  // the hash arguments are content hashes from decoder.h; when given and
+  // equal to the stored content's, the message is not copied again.
+  // updateGeometry returns whether the geometry changed.
+  bool updateGeometry(const SSL_GeometryData &g, uint64_t hash = 0);
   void updateVision(const SSL_DetectionFrame &d);
-  void updateReferee(const SSL_Referee &r);
+  void updateReferee(const SSL_Referee &r, uint64_t hash = 0);
+
+  // updateVision split in two, so that a burst of camera frames can all be
+  // fed to the tracker before the events run once on the resulting world
+  void addVision(const SSL_DetectionFrame &d);
+  bool step();
+
+  void useCaptureClock()
+  {
+    capture_clock = true;
+    clock_offset = 0;
+  }
+
+  // wall-clock time (seconds) at which some event next needs to run even if
+  // no vision arrives, or 0 if there is no pending deadline
+  double nextWakeTime() const;
+
+  // run the events whose deadlines have passed at wall-clock time now,
+  // against the last world; returns whether any were due
+  bool tick(double now);
+
+  void setOutput(FILE *out_)
+  {
+    out = out_;
+  }
+  FILE *output() const
+  {
+    return out;
+  }
+
+  // whether to call the events through the vtable instead of their pipeline
+  // (for comparing the two)
+  void setStaticDispatch(bool on)
+  {
+    static_dispatch = on;
+  }
+
+  // process the Independent events on this many threads besides the
+  // autoref's own (0, the default, processes every event on the autoref's
+  // thread); the results are the same either way
+  void setRuleThreads(int threads);
+
+  // called (on the autoref thread) for each event that newly fires
+  void setFiredListener(std::function<void(const AutorefEvent *, const World &)> listener)
+  {
+    fired_listener = listener;
+  }
+
+  // process() calls made on events so far (each frame only calls the events
+  // that apply in the current state and stage)
+  uint64_t dispatchCount() const
+  {
+    return dispatch_count;
+  }
+  size_t eventCount() const
+  {
+    return events.size();
+  }
+
+  // the time taken by the tracker updates and by each event's processing
+  void printLatency(FILE *f) const;
+
+  const WorldHistory &worldHistory() const
+  {
+    return world_history;
+  }
+
+  const std::map<std::string, int> &firedCounts() const
+  {
+    return fired_counts;
+  }
 
   AutorefVariables getState()
   {
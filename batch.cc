@@ -0,0 +1,117 @@
+#include "batch.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+#include "autoref.h"
+#include "eval_ref.h"
+
+static void evaluateMatch(MatchResult &result, bool full, bool division_b, bool partial)
+{
+  // constants are per thread, so set them up for each match
+  if (division_b) {
+    Constants::initDivisionB();
+  }
+  else {
+    Constants::initDivisionA();
+  }
+
+  std::unique_ptr<BaseAutoref> autoref;
+  if (full) {
+    autoref.reset(new Autoref(false));
+  }
+  else {
+    autoref.reset(new EvaluationAutoref(false));
+  }
+  autoref->tracker.setPartialUpdates(partial);
+
+  char *buf = nullptr;
+  size_t len = 0;
+  FILE *out = open_memstream(&buf, &len);
+  autoref->setOutput(out);
+
+  result.opened = ReplayLog(result.path.c_str(), *autoref, result.stats);
+
+  fclose(out);
+  result.output.assign(buf, len);
+  free(buf);
+  result.fired = autoref->firedCounts();
+}
+
+std::vector<MatchResult> EvaluateBatch(
+  const std::vector<std::string> &logs, bool full, bool division_b, bool partial, int jobs)
+{
+  std::vector<MatchResult> results(logs.size());
+  for (size_t i = 0; i < logs.size(); i++) {
+    results[i].path = logs[i];
+  }
+
+  if (jobs <= 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  jobs = std::min<int>(jobs, logs.size());
+
+  // workers take the next match until none are left
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t i; (i = next.fetch_add(1)) < results.size();) {
+      evaluateMatch(results[i], full, division_b, partial);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < jobs; i++) {
+    workers.emplace_back(work);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
+  return results;
+}
+
+void PrintBatchReport(const std::vector<MatchResult> &results, double wall_time, FILE *f)
+{
+  uint64_t total_frames = 0;
+  double total_match_time = 0;
+  std::map<std::string, int> total_fired;
+
+  for (const MatchResult &r : results) {
+    fprintf(f, "\n\x1b[35;1m==== %s ====\x1b[m\n", r.path.c_str());
+    if (!r.opened) {
+      fprintf(f, "could not open log\n");
+      continue;
+    }
+    fputs(r.output.c_str(), f);
+
+    const ReplayStats &s = r.stats;
+    fprintf(f,
+            "\n-- %lu packets, %lu frames, %.1f s of match in %.3f s (%.0f frames/s), %lu refbox requests\n",
+            s.packets,
+            s.frames,
+            s.match_time,
+            s.wall_time,
+            s.wall_time > 0 ? s.frames / s.wall_time : 0,
+            s.decisions);
+    for (const auto &e : r.fired) {
+      fprintf(f, "-- %s: %d\n", e.first.c_str(), e.second);
+      total_fired[e.first] += e.second;
+    }
+
+    total_frames += s.frames;
+    total_match_time += s.match_time;
+  }
+
+  fprintf(f, "\n\x1b[35;1m==== %zu matches ====\x1b[m\n", results.size());
+  for (const auto &e : total_fired) {
+    fprintf(f, "-- %s: %d\n", e.first.c_str(), e.second);
+  }
+  fprintf(f,
+          "%lu frames, %.1f s of match in %.3f s: %.0f frames/s (%.1fx real time)\n",
+          total_frames,
+          total_match_time,
+          wall_time,
+          wall_time > 0 ? total_frames / wall_time : 0,
+          wall_time > 0 ? total_match_time / wall_time : 0);
+}
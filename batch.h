@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "replay.h"
+
+struct MatchResult
+{
+  std::string path;
+  bool opened;
+  ReplayStats stats;
+
+  // everything the autoref printed while refereeing this match
+  std::string output;
+
+  // number of times each event fired
+  std::map<std::string, int> fired;
+
+  MatchResult() : opened(false)
+  {
+  }
+};
+
+// Re-referee recorded matches: each log is replayed through its own autoref
+// instance (Autoref if full, else EvaluationAutoref; with partial world
+// updates if partial), spread over jobs worker threads (0 means one per core).
+// Results are in the order of logs.
+std::vector<MatchResult> EvaluateBatch(
+  const std::vector<std::string> &logs, bool full, bool division_b, bool partial, int jobs);
+
+// print each match's output followed by its summary, then overall totals
+void PrintBatchReport(const std::vector<MatchResult> &results, double wall_time, FILE *f);
@@ -0,0 +1,174 @@
+// Compares ball velocity from the old tracker path (one camera chosen by
+// affinity, 5-sample least squares fit) with BallFilter fusing every camera,
+// on a simulated ball with kicks, overlapping cameras with small calibration
+// offsets and detection noise. Also times BallFilter::update.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "constants.h"
+#include "kalman.h"
+#include "tracker.h"
+
+static const int Cameras = 4;
+static const double FrameRate = 60;
+static const double Duration = 600;
+static const double KickEvery = 3;
+static const double NoiseSigma = 3;
+// after a kick or bounce, skip this long when measuring the error, for both methods
+static const double Settle = .2;
+
+struct Detection
+{
+  int camera;
+  double t;
+  vector2f loc;
+};
+
+struct Stats
+{
+  double sq_err;
+  int n;
+  int spikes;
+
+  Stats() : sq_err(0), n(0), spikes(0)
+  {
+  }
+
+  void add(vector2f est, vector2f truth)
+  {
+    double e = dist(est, truth);
+    sq_err += e * e;
+    n++;
+    if (e > 1000) {
+      spikes++;
+    }
+  }
+};
+
+int main()
+{
+  Constants::initDivisionA();
+
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0, NoiseSigma);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+
+  // camera c covers one quadrant, plus 500 mm of overlap with its neighbours
+  double cal_x[Cameras], cal_y[Cameras];
+  for (int c = 0; c < Cameras; c++) {
+    cal_x[c] = 15 * uniform(rng);
+    cal_y[c] = 15 * uniform(rng);
+  }
+  auto sees = [](int c, vector2d<double> p) {
+    bool right = (c & 1), top = (c & 2);
+    return (right ? p.x > -500 : p.x < 500) && (top ? p.y > -500 : p.y < 500);
+  };
+
+  // simulate: rolling with friction, kicked toward the middle every few
+  // seconds, bouncing off the field edges (bounces count as kicks)
+  std::vector<std::vector<Detection>> rounds;
+  std::vector<vector2f> truth_vel;
+  std::vector<double> since_kick;
+  vector2d<double> p(0, 0), v(0, 0);
+  double last_kick = -KickEvery;
+  double dt = 1 / FrameRate;
+  for (double t = 0; t < Duration; t += dt) {
+    if (t - last_kick >= KickEvery) {
+      double a = M_PI * uniform(rng);
+      double speed = 2000 + 2000 * fabs(uniform(rng));
+      v.set(speed * cos(a) - p.x, speed * sin(a) - p.y);
+      v = v.norm() * speed;
+      last_kick = t;
+    }
+    p += v * dt;
+    v *= exp(-BallFilter::Friction * dt);
+    if (fabs(p.x) > 5000) {
+      v.x = -v.x;
+      last_kick = t;
+    }
+    if (fabs(p.y) > 3500) {
+      v.y = -v.y;
+      last_kick = t;
+    }
+
+    std::vector<Detection> round;
+    for (int c = 0; c < Cameras; c++) {
+      if (sees(c, p)) {
+        // cameras are not synchronized
+        double tc = t + .002 * c;
+        vector2d<double> pc = p + v * (.002 * c);
+        round.push_back(
+          {c, tc, vector2f(pc.x + cal_x[c] + noise(rng), pc.y + cal_y[c] + noise(rng))});
+      }
+    }
+    rounds.push_back(round);
+    truth_vel.push_back(vector2f(v.x, v.y));
+    since_kick.push_back(t - last_kick);
+  }
+
+  // old path: per-camera observations, one chosen by affinity
+  Stats old_stats;
+  {
+    Tracker::ObjectTracker ball;
+    for (size_t i = 0; i < rounds.size(); i++) {
+      for (const Detection &d : rounds[i]) {
+        Tracker::Observation &obs = ball.obs[d.camera];
+        obs.valid = true;
+        obs.time = d.t;
+        obs.conf = .9;
+        obs.loc = d.loc;
+      }
+      if (ball.mergeObservations() >= 0 && since_kick[i] > Settle) {
+        old_stats.add(ball.fitVelocity(), truth_vel[i]);
+      }
+      for (auto &obs : ball.obs) {
+        if (obs.valid) {
+          obs.valid = false;
+          obs.last_valid = 1;
+        }
+        else {
+          obs.last_valid++;
+        }
+      }
+    }
+  }
+
+  // filter: every detection, then read at the round's time
+  Stats filter_stats;
+  double sigma_sum = 0;
+  BallFilter filter;
+  int updates = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rounds.size(); i++) {
+    for (const Detection &d : rounds[i]) {
+      filter.update(d.t, d.loc, .9);
+      updates++;
+    }
+    if (!rounds[i].empty() && since_kick[i] > Settle) {
+      filter_stats.add(filter.vel(rounds[i].back().t), truth_vel[i]);
+      sigma_sum += sqrt(filter.velVar());
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+  printf("%d cameras, %.0f s, %zu frames, %d detections\n", Cameras, Duration, rounds.size(), updates);
+  printf("%-28s %8.1f mm/s rms velocity error  %5d errors > 1 m/s\n",
+         "affinity + 5-sample fit",
+         sqrt(old_stats.sq_err / old_stats.n),
+         old_stats.spikes);
+  printf("%-28s %8.1f mm/s rms velocity error  %5d errors > 1 m/s\n",
+         "BallFilter",
+         sqrt(filter_stats.sq_err / filter_stats.n),
+         filter_stats.spikes);
+  printf("BallFilter: %.1f ns/update (incl. reading), %lu rejected, %lu restarts, mean velocity sigma %.1f mm/s\n",
+         ns / updates,
+         filter.rejectCount(),
+         filter.resetCount(),
+         sigma_sum / filter_stats.n);
+  return 0;
+}
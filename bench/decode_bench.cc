@@ -0,0 +1,147 @@
+// Compares per-frame heap allocations and time of the old decoding path
+// (long-lived messages, referee and geometry deep-copied on every packet)
+// against FrameDecoder (per-frame arena, unchanged content skipped by hash).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "decoder.h"
+#include "synth.h"
+
+static uint64_t allocations = 0;
+
+void *operator new(size_t n)
+{
+  allocations++;
+  void *p = malloc(n ? n : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+struct Frame
+{
+  std::vector<std::string> vision;
+  std::string referee;
+};
+
+static const int Frames = 2000;
+static const int GeometryEvery = 30;
+
+template <typename F>
+static void run(const char *name, const std::vector<Frame> &frames, F process)
+{
+  // first pass includes growing the long-lived messages / arena
+  uint64_t w0 = allocations;
+  for (const Frame &f : frames) {
+    process(f);
+  }
+  printf("%-24s %8.2f allocations/frame in the first pass\n",
+         name,
+         static_cast<double>(allocations - w0) / frames.size());
+
+  uint64_t a0 = allocations;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const Frame &f : frames) {
+    process(f);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  uint64_t a1 = allocations;
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-24s %8.2f allocations/frame %10.0f ns/frame\n",
+         name,
+         static_cast<double>(a1 - a0) / frames.size(),
+         ns / frames.size());
+}
+
+int main()
+{
+  std::vector<Frame> frames(Frames);
+  std::string geometry = SynthGeometry().SerializeAsString();
+  for (int i = 0; i < Frames; i++) {
+    double t = i / 60.;
+    for (int c = 0; c < SynthCameras; c++) {
+      frames[i].vision.push_back(SynthVision(c, i, t).SerializeAsString());
+    }
+    if (i % GeometryEvery == 0) {
+      frames[i].vision.push_back(geometry);
+    }
+    frames[i].referee = SynthReferee(t).SerializeAsString();
+  }
+
+  printf("%d frames, %d cameras, geometry every %d frames\n", Frames, SynthCameras, GeometryEvery);
+
+  {
+    SSL_WrapperPacket vision_msg;
+    SSL_Referee ref_msg, stored_ref;
+    SSL_GeometryData stored_geometry;
+    run("long-lived messages", frames, [&](const Frame &f) {
+      for (const std::string &v : f.vision) {
+        vision_msg.ParseFromArray(v.data(), v.size());
+        if (vision_msg.has_geometry()) {
+          stored_geometry.CopyFrom(vision_msg.geometry());
+        }
+      }
+      ref_msg.ParseFromArray(f.referee.data(), f.referee.size());
+      stored_ref = ref_msg;
+    });
+  }
+
+  {
+    run("fresh messages per packet", frames, [&](const Frame &f) {
+      for (const std::string &v : f.vision) {
+        SSL_WrapperPacket vision_msg;
+        vision_msg.ParseFromArray(v.data(), v.size());
+      }
+      SSL_Referee ref_msg;
+      ref_msg.ParseFromArray(f.referee.data(), f.referee.size());
+    });
+  }
+
+  {
+    FrameDecoder decoder;
+    SSL_Referee stored_ref;
+    SSL_GeometryData stored_geometry;
+    uint64_t geometry_hash = 0, ref_hash = 0;
+    uint64_t peak = 0;
+    run("arena + content hashes", frames, [&](const Frame &f) {
+      for (const std::string &v : f.vision) {
+        const SSL_WrapperPacket *w = decoder.parseVision(v.data(), v.size());
+        if (w != nullptr && w->has_geometry()) {
+          uint64_t h = GeometryHash(v.data(), v.size());
+          if (h != geometry_hash) {
+            geometry_hash = h;
+            stored_geometry.CopyFrom(w->geometry());
+          }
+        }
+      }
+      const SSL_Referee *r = decoder.parseReferee(f.referee.data(), f.referee.size());
+      uint64_t h = RefereeHash(f.referee.data(), f.referee.size());
+      if (h != ref_hash) {
+        ref_hash = h;
+        stored_ref = *r;
+      }
+      else {
+        stored_ref.set_packet_timestamp(r->packet_timestamp());
+        stored_ref.set_stage_time_left(r->stage_time_left());
+      }
+      peak = std::max(peak, decoder.spaceUsed());
+      decoder.reset();
+    });
+    printf("peak arena use per frame: %lu bytes (initial block %lu)\n", peak, FrameDecoder::DefaultBlockSize);
+  }
+  return 0;
+}
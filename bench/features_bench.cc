@@ -0,0 +1,104 @@
+// Times the per-frame geometry cost of n rules that each need the ball
+// distance, ball-relative position and defense-area distances of every
+// robot plus the ball's field and goal status, computed either by each rule
+// itself or through a WorldFeatures shared by all of them, filled in either
+// as the rules ask or all at once by computeAll (as BaseAutoref::speculate does
+// for the rule threads).
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "constants.h"
+#include "geomalgo.h"
+#include "synth.h"
+#include "util.h"
+#include "world_features.h"
+
+static const int Frames = 20000;
+static const int RobotsPerTeam = 8;
+
+// what one rule decides from the geometry; the result only keeps the work
+// from being optimized away
+struct Rule
+{
+  template <typename Geometry>
+  int run(const World &w, const Geometry &g) const
+  {
+    int n = g.ballInField() + 2 * g.ballInGoal();
+    for (const auto &r : w.robots) {
+      vector2f local = g.ballLocal(r);
+      n += g.ballDist(r) < 500;
+      n += fabs(local.y) < 50 && local.x > 0;
+      n += g.defenseDist(r, true) < 300 || g.defenseDist(r, false) < 300;
+    }
+    return n;
+  }
+};
+
+// the same interface as WorldFeatures, computing everything on every call
+struct DirectGeometry
+{
+  const World *world;
+
+  float ballDist(const WorldRobot &r) const
+  {
+    return (r.loc - world->ball.loc).length();
+  }
+  vector2f ballLocal(const WorldRobot &r) const
+  {
+    return (world->ball.loc - r.loc).rotate(-r.angle);
+  }
+  double defenseDist(const WorldRobot &r, bool positive_x) const
+  {
+    return DistToDefenseArea(r.loc, positive_x);
+  }
+  bool ballInField() const
+  {
+    return IsInField(world->ball.loc, -Constants::BallRadius, false);
+  }
+  bool ballInGoal() const
+  {
+    return IsInGoal(world->ball.loc);
+  }
+};
+
+int main()
+{
+  Constants::initDivisionA();
+  std::vector<World> worlds = SynthWorlds(Frames, RobotsPerTeam);
+
+  printf("%d frames, %d robots; ns/frame for all rules\n", Frames, NumTeams * RobotsPerTeam);
+  printf("%6s %10s %10s %10s\n", "rules", "per-rule", "shared", "batched");
+
+  Rule rule;
+  WorldFeatures features;
+  for (int rules = 1; rules <= 16; rules *= 2) {
+    double direct = NsPerFrame(worlds, [&](const World &w) {
+      DirectGeometry g{&w};
+      int n = 0;
+      for (int i = 0; i < rules; i++) {
+        n += rule.run(w, g);
+      }
+      return n;
+    });
+    double shared = NsPerFrame(worlds, [&](const World &w) {
+      features.reset(&w);
+      int n = 0;
+      for (int i = 0; i < rules; i++) {
+        n += rule.run(w, features);
+      }
+      return n;
+    });
+    double batched = NsPerFrame(worlds, [&](const World &w) {
+      features.reset(&w);
+      features.computeAll();
+      int n = 0;
+      for (int i = 0; i < rules; i++) {
+        n += rule.run(w, features);
+      }
+      return n;
+    });
+    printf("%6d %10.0f %10.0f %10.0f\n", rules, direct, shared, batched);
+  }
+}
@@ -0,0 +1,135 @@
+// Times fitting a velocity to a sliding window of samples after each new
+// one, either by summing over the window again (as linvel and fitVelocity
+// did) or with a LinearFit, and checks how far the LinearFit drifts from the
+// recomputed fit over a long match with wall-clock (Unix) timestamps, next
+// to running sums kept over the raw timestamps.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "linear_fit.h"
+
+static const int Samples = 1000000;
+static const double Start = 1.7e9;
+static const double Period = 1 / 60.0;
+
+static std::vector<tvec> makeSamples()
+{
+  std::vector<tvec> s(Samples);
+  for (int i = 0; i < Samples; i++) {
+    double t = i * Period;
+    s[i] = tvec(Start + t, vector2f(4000 * cos(.3 * t) + 3 * sin(17 * t), 3000 * sin(.2 * t)));
+  }
+  return s;
+}
+
+// the velocity fitted to the n samples ending at s[end], summed from scratch
+static vector2f refit(const std::vector<tvec> &s, int end, int n)
+{
+  double t0 = s[end - n + 1].t;
+  double st = 0, stt = 0, sx = 0, sy = 0, stx = 0, sty = 0;
+  for (int i = end - n + 1; i <= end; i++) {
+    double t = s[i].t - t0;
+    st += t;
+    stt += t * t;
+    sx += s[i].v.x;
+    sy += s[i].v.y;
+    stx += t * s[i].v.x;
+    sty += t * s[i].v.y;
+  }
+  double d = n * stt - st * st;
+  return vector2f((n * stx - st * sx) / d, (n * sty - st * sy) / d);
+}
+
+// running sums over raw timestamps, for comparison
+template <int N>
+struct RawSums
+{
+  std::vector<tvec> window;
+  double st = 0, stt = 0, sx = 0, sy = 0, stx = 0, sty = 0;
+
+  void add(const tvec &s, double sign)
+  {
+    st += sign * s.t;
+    stt += sign * s.t * s.t;
+    sx += sign * s.v.x;
+    sy += sign * s.v.y;
+    stx += sign * s.t * s.v.x;
+    sty += sign * s.t * s.v.y;
+  }
+  void add(const tvec &s)
+  {
+    if (window.size() == N) {
+      add(window.front(), -1);
+      window.erase(window.begin());
+    }
+    window.push_back(s);
+    add(s, 1);
+  }
+  vector2f velocity() const
+  {
+    double d = N * stt - st * st;
+    return vector2f((N * stx - st * sx) / d, (N * sty - st * sy) / d);
+  }
+};
+
+template <int N>
+static void run(const std::vector<tvec> &s)
+{
+  double sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = N - 1; i < Samples; i++) {
+    sink += refit(s, i, N).x;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  LinearFit<N> fit;
+  for (int i = 0; i < N - 1; i++) {
+    fit.add(s[i].t, s[i].v);
+  }
+  for (int i = N - 1; i < Samples; i++) {
+    fit.add(s[i].t, s[i].v);
+    sink += fit.velocity().x;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  // drift, checked on every 997th window
+  double drift = 0, raw_drift = 0;
+  RawSums<N> raw;
+  fit.clear();
+  for (int i = 0; i < Samples; i++) {
+    fit.add(s[i].t, s[i].v);
+    raw.add(s[i]);
+    if (i >= N && i % 997 == 0) {
+      vector2f v = refit(s, i, N);
+      drift = std::max<double>(drift, (fit.velocity() - v).length());
+      raw_drift = std::max<double>(raw_drift, (raw.velocity() - v).length());
+    }
+  }
+
+  int windows = Samples - N + 1;
+  printf("%6d %12.1f %12.1f %14.2e %14.2e\n",
+         N,
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / windows,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / windows,
+         drift,
+         raw_drift);
+  if (sink == 42) {
+    puts("");
+  }
+}
+
+int main()
+{
+  std::vector<tvec> s = makeSamples();
+
+  printf("%d samples from t = %.1e s; ns per new sample\n", Samples, Start);
+  printf("%6s %12s %12s %14s %14s\n", "window", "refit", "LinearFit", "drift (mm/s)", "raw sums");
+  run<4>(s);
+  run<8>(s);
+  run<16>(s);
+  run<32>(s);
+}
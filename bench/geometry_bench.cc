@@ -0,0 +1,92 @@
+// Times computing the ball distance, ball-relative position and both
+// defense-area distances of every robot, either robot by robot with the
+// scalar helpers (as WorldFeatures::computeAll used to) or with each
+// ComputeRobotGeometry kernel the CPU can run, and counts the values in
+// which a kernel differs from the helpers at all. Loading the RobotArrays
+// (which takes each robot's sine and cosine) is timed separately, since
+// every kernel needs it and the helpers instead pay for it inside rotate.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "constants.h"
+#include "geomalgo.h"
+#include "robot_geometry.h"
+#include "synth.h"
+#include "util.h"
+
+static const int Frames = 20000;
+static const int RobotsPerTeam = 11;
+
+static void scalarHelpers(const World &w, RobotGeometry &out)
+{
+  for (const WorldRobot &r : w.robots) {
+    int s = RobotSet::slot(r.robot_id);
+    out.ball_dist[s] = (r.loc - w.ball.loc).length();
+    vector2f local = (w.ball.loc - r.loc).rotate(-r.angle);
+    out.ball_local_x[s] = local.x;
+    out.ball_local_y[s] = local.y;
+    out.defense_dist[0][s] = DistToDefenseArea(r.loc, false);
+    out.defense_dist[1][s] = DistToDefenseArea(r.loc, true);
+  }
+}
+
+// the number of values for robots in w that differ between a and b
+static int mismatches(const World &w, const RobotGeometry &a, const RobotGeometry &b)
+{
+  int n = 0;
+  auto differ = [](float x, float y) { return memcmp(&x, &y, sizeof(x)) != 0; };
+  for (const WorldRobot &r : w.robots) {
+    int s = RobotSet::slot(r.robot_id);
+    n += differ(a.ball_dist[s], b.ball_dist[s]);
+    n += differ(a.ball_local_x[s], b.ball_local_x[s]);
+    n += differ(a.ball_local_y[s], b.ball_local_y[s]);
+    n += differ(a.defense_dist[0][s], b.defense_dist[0][s]);
+    n += differ(a.defense_dist[1][s], b.defense_dist[1][s]);
+  }
+  return n;
+}
+
+int main()
+{
+  Constants::initDivisionA();
+  std::vector<World> worlds = SynthWorlds(Frames, RobotsPerTeam);
+  std::vector<RobotGeometry> expected(Frames), got(Frames);
+
+  printf("%d frames, %d robots\n", Frames, NumTeams * RobotsPerTeam);
+  printf("%-8s %10s %12s\n", "", "ns/frame", "mismatches");
+  RobotGeometry *out = expected.data();
+  printf("%-8s %10.0f %12d\n", "helpers", NsPerFrame(worlds, [&](const World &w) {
+           scalarHelpers(w, *out);
+           return out++->ball_dist[0];
+         }), 0);
+
+  std::vector<RobotArrays> arrays(Frames);
+  auto t0 = std::chrono::steady_clock::now();
+  for (int f = 0; f < Frames; f++) {
+    arrays[f].load(worlds[f].robots);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  printf("%-8s %10.0f\n", "load", std::chrono::duration<double, std::nano>(t1 - t0).count() / Frames);
+
+  GeometryKernel best = BestGeometryKernel();
+  for (GeometryKernel kernel : {GeometryKernel::Scalar, GeometryKernel::SSE2, GeometryKernel::AVX2}) {
+    if (kernel > best) {
+      break;
+    }
+    const RobotArrays *a = arrays.data();
+    RobotGeometry *out = got.data();
+    double ns = NsPerFrame(worlds, [&](const World &w) {
+      ComputeRobotGeometry(*a++, w.ball.loc, *out, kernel);
+      return out++->ball_dist[0];
+    });
+    int bad = 0;
+    for (int f = 0; f < Frames; f++) {
+      bad += mismatches(worlds[f], expected[f], got[f]);
+    }
+    printf("%-8s %10.0f %12d\n", GeometryKernelName(kernel), ns, bad);
+  }
+}
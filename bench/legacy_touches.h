@@ -0,0 +1,298 @@
+#pragma once
+
+// The touch processors that BallTouchedEvent ran in turn before
+// TouchEngine, kept for touch_bench to compare against.
+
+#include <cmath>
+
+#include "constants.h"
+#include "geomalgo.h"
+#include "linear_fit.h"
+#include "util.h"
+#include "world_history.h"
+
+struct CollideResult
+{
+public:
+  RobotID robot_id;
+  double time;
+
+  CollideResult() : time(0)
+  {
+  }
+  CollideResult(RobotID id, double time) : robot_id(id), time(time)
+  {
+  }
+};
+
+class TouchProcessor
+{
+public:
+  // history[0] is the world being processed
+  virtual bool proc(const WorldHistory &history, CollideResult &res) = 0;
+  virtual const char *name() = 0;
+};
+
+class AccelProcessor : public TouchProcessor
+{
+public:
+  bool proc(const WorldHistory &history, CollideResult &res);
+  const char *name()
+  {
+    return "AccelProcessor";
+  }
+};
+
+class RobotDistProcessor : public TouchProcessor
+{
+  int last;
+
+public:
+  RobotDistProcessor() : last(0)
+  {
+  }
+
+  bool proc(const WorldHistory &history, CollideResult &res);
+  const char *name()
+  {
+    return "RobotDistProcessor";
+  }
+};
+
+// up to n samples gathered from a WorldHistory, newest first, and indexed
+// like RunningQueue (0 is the newest, -size() + 1 the oldest)
+template <const int n>
+class SampleWindow
+{
+  tvec vals[n];
+  int num;
+
+public:
+  SampleWindow() : num(0)
+  {
+  }
+
+  void addOlder(const tvec &v)
+  {
+    vals[num++] = v;
+  }
+
+  bool full() const
+  {
+    return num == n;
+  }
+  int size() const
+  {
+    return num;
+  }
+  const tvec &operator[](int i) const
+  {
+    return vals[-i];
+  }
+};
+
+class BackTrackProcessor : public TouchProcessor
+{
+  static const int VEL_SAMPLES = 4;
+  static const int COMP_SAMPLES = 4;
+  static const int HIST_LEN = VEL_SAMPLES + COMP_SAMPLES;
+  float t0;
+
+  int last;
+
+public:
+  BackTrackProcessor() : t0(0), last(0)
+  {
+  }
+
+  bool proc(const WorldHistory &history, CollideResult &res);
+  const char *name()
+  {
+    return "BackTrackProcessor";
+  }
+};
+
+inline bool AccelProcessor::proc(const WorldHistory &history, CollideResult &res)
+{
+  const World &w = history[0];
+
+  if (w.ball.conf < .1) {
+    return false;
+  }
+
+  if (history.size() < 3) {
+    return false;
+  }
+
+  vector2f delta = history[-1].ball.loc - (history[0].ball.loc + history[-2].ball.loc) / 2;
+  double accel = delta.length() * Constants::FrameRate * Constants::FrameRate;
+
+  if (accel < 2000) {
+    return false;
+  }
+
+  vector2f ball_pt = history[-1].ball.loc;
+  double closest_dist = HUGE_VALF;
+  WorldRobot closest_robot;
+  for (const auto &r : w.robots) {
+    if (dist(r.loc, ball_pt) < closest_dist) {
+      closest_dist = dist(r.loc, ball_pt);
+      closest_robot = r;
+    }
+  }
+
+  bool near = closest_dist < Constants::MaxRobotRadius + Constants::BallRadius + 10;
+  if (!near) {
+    return false;
+  }
+
+  res.robot_id = closest_robot.robot_id;
+  res.time = history[-1].time;
+
+  return true;
+}
+
+inline bool RobotDistProcessor::proc(const WorldHistory &history, CollideResult &res)
+{
+  last++;
+  const World &w = history[0];
+  double t = w.time;
+  const WorldBall &ball = w.ball;
+
+  if (!ball.visible()) {
+    return false;
+  }
+
+  bool found = false;
+
+  for (const auto &r : w.robots) {
+    if (!r.visible()) {
+      continue;
+    }
+    // the ball relative to the robot over the recent frames where both were
+    // seen, as long as they span at most 15 frame periods
+    SampleWindow<6> hist;
+    for (int i = 0; history.isValidIdx(i) && !hist.full() && t - history.time(i) <= 15 * Constants::FramePeriod; i--) {
+      const WorldRobot *old = history.robot(r.robot_id, i);
+      if (history.ball(i).visible() && old != nullptr && old->visible()) {
+        hist.addOlder(tvec(history.time(i), history.ball(i).loc - old->loc));
+      }
+    }
+
+    if (hist.size() < 6) {
+      continue;
+    }
+
+    // fprintf(stderr, "---- %d\n", r.robot_id);
+    // for(int i = -5; i <= 0; i++)
+    //   fprintf(stderr, "%f %.0f,%.0f\n", hist[i].t, V2COMP(hist[i].v));
+
+    // check that the last three and three before that are in straight lines
+    if (!hist[-4].between(hist[-5], hist[-3]) || !hist[-1].between(hist[0], hist[-2])) {
+      continue;
+    }
+
+    // check that they're not all in a straight line
+    if (cosine(hist[-5].v - hist[-3].v, hist[0].v - hist[-2].v) < -.99) {
+      continue;
+    }
+
+    vector2f inter = intersection(hist[-5].v, hist[-3].v, hist[-2].v, hist[0].v);
+
+    double t0 = point_on_segment_t(hist[-5].v, hist[-3].v, inter);
+    double t1 = point_on_segment_t(hist[0].v, hist[-2].v, inter);
+    if (t0 < .9 || t1 < .9) {
+      continue;
+    }
+
+    if (inter.length() < Constants::MaxRobotRadius + Constants::BallRadius + 30 && inter.length() < hist[-5].v.length()
+        && inter.length() < hist[0].v.length()) {
+      res.robot_id = r.robot_id;
+      res.time = t - 2 * Constants::FramePeriod;
+      found = true;
+    }
+  }
+
+  if (found && last > 3) {
+    last = 0;
+    return true;
+  }
+
+  return false;
+}
+
+inline bool BackTrackProcessor::proc(const WorldHistory &history, CollideResult &res)
+{
+  last++;
+  const World &w = history[0];
+  double t = w.time;
+  const WorldBall &ball = w.ball;
+
+  if (t0 == 0) {
+    t0 = t;
+  }
+
+  if (ball.conf < .1) {
+    return false;
+  }
+
+  bool found = false;
+  for (const auto &r : w.robots) {
+    if (!r.visible()) {
+      continue;
+    }
+    // the ball relative to the robot over the recent frames where both were
+    // seen, as long as they span at most 3 * HIST_LEN frame periods
+    SampleWindow<HIST_LEN> hist;
+    for (int i = 0; history.isValidIdx(i) && !hist.full() && t - history.time(i) <= 3 * HIST_LEN * Constants::FramePeriod;
+         i--) {
+      const WorldRobot *old = history.robot(r.robot_id, i);
+      if (history.ball(i).conf >= .1 && old != nullptr && old->visible()) {
+        hist.addOlder(tvec(history.time(i) - t0, history.ball(i).loc - old->loc));
+      }
+    }
+
+    // not enough recent samples; give up
+    if (hist.size() < HIST_LEN) {
+      continue;
+    }
+
+    // check whether ball passed "through" the robot before the last few
+    // samples (probably was chipped over)
+    bool through = false;
+    for (int i = -HIST_LEN + 1; i < -VEL_SAMPLES + 1; i++) {
+      double seg_dist = distance_to_segment(hist[i].v, hist[i + 1].v, vector2f(0, 0));
+      if (seg_dist < Constants::MaxRobotRadius - Constants::BallRadius) {
+        through = true;
+        break;
+      }
+    }
+    if (through) {
+      continue;
+    }
+
+    // estimate velocity of ball from last VEL_SAMPLES samples and extrapolate
+    // backward before that
+    LinearFit<VEL_SAMPLES> fit;
+    for (int i = -VEL_SAMPLES + 1; i <= 0; i++) {
+      fit.add(hist[i].t, hist[i].v);
+    }
+    double t_first = hist[-VEL_SAMPLES + 1].t;
+
+    for (int i = -2; i < 0; i++) {
+      vector2f old_pos(fit.position(t_first + i * Constants::FramePeriod));
+      if (old_pos.length() < Constants::MaxRobotRadius + Constants::BallRadius - 10) {
+        res.robot_id = r.robot_id;
+        res.time = t - 2 * Constants::FramePeriod;
+        found = true;
+      }
+    }
+  }
+
+  if (found && last > 3) {
+    last = 0;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,78 @@
+// Times a vision frame through each engine (tracker update plus events) with
+// the events called through their EventPipeline or through the vtable, and
+// with the Independent ones processed on RuleThreads extra threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "autoref.h"
+#include "eval_ref.h"
+#include "synth.h"
+
+static const int Frames = 20000;
+static const int Cameras = 2;
+static const int Runs = 5;
+static const int RuleThreads = 2;
+
+template <typename Engine>
+static double nsPerFrame(const std::vector<SSL_DetectionFrame> &frames,
+                         bool static_dispatch,
+                         int rule_threads,
+                         uint64_t &dispatched)
+{
+  FILE *null = fopen("/dev/null", "w");
+  Engine ref(false);
+  ref.setOutput(null);
+  ref.useCaptureClock();
+  ref.setStaticDispatch(static_dispatch);
+  ref.setRuleThreads(rule_threads);
+  ref.updateGeometry(SynthGeometry().geometry());
+  ref.updateReferee(SynthReferee(0));
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (const SSL_DetectionFrame &d : frames) {
+    ref.addVision(d);
+    ref.step();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  dispatched = ref.dispatchCount();
+  fclose(null);
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / frames.size();
+}
+
+// the best of a few runs each, alternating between the two
+template <typename Engine>
+static void compare(const char *name, const std::vector<SSL_DetectionFrame> &frames)
+{
+  double t_static = 1e30, t_virtual = 1e30, t_threads = 1e30;
+  uint64_t dispatched;
+  for (int run = 0; run < Runs; run++) {
+    t_static = std::min(t_static, nsPerFrame<Engine>(frames, true, 0, dispatched));
+    t_virtual = std::min(t_virtual, nsPerFrame<Engine>(frames, false, 0, dispatched));
+    t_threads = std::min(t_threads, nsPerFrame<Engine>(frames, true, RuleThreads, dispatched));
+  }
+  printf("%-12s %10.0f %10.0f %10.0f %14.2f\n",
+         name,
+         t_static,
+         t_virtual,
+         t_threads,
+         static_cast<double>(dispatched) / frames.size());
+}
+
+int main()
+{
+  Constants::initDivisionA();
+
+  std::vector<SSL_DetectionFrame> frames;
+  for (int f = 0; f < Frames; f++) {
+    frames.push_back(SynthVision(f % Cameras, f / Cameras, 1 + f / (60.0 * Cameras)).detection());
+  }
+
+  printf("%d frames from %d cameras; ns/frame\n", Frames, Cameras);
+  printf("%-12s %10s %10s %10s %14s\n", "engine", "pipeline", "virtual", "threads", "events/frame");
+  compare<EvaluationAutoref>("evaluation", frames);
+  compare<Autoref>("autoref", frames);
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+// Synthetic SSL-Vision and refbox packets and tracked worlds for the
+// benchmarks.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "messages_robocup_ssl_wrapper.pb.h"
+#include "ssl_referee.pb.h"
+
+#include "constants.h"
+#include "world.h"
+
+static const int SynthCameras = 8;
+static const int SynthRobotsPerTeam = 8;
+
+inline void SynthRobot(SSL_DetectionRobot *r, int id, float x, float y)
+{
+  r->set_confidence(.9);
+  r->set_robot_id(id);
+  r->set_x(x);
+  r->set_y(y);
+  r->set_orientation(.1 * id);
+  r->set_pixel_x(0);
+  r->set_pixel_y(0);
+}
+
+// one camera's detection frame at time t; every camera sees all robots and
+// the ball, as they would in the overlap between cameras
+inline SSL_WrapperPacket SynthVision(int camera, int frame, double t)
+{
+  SSL_WrapperPacket packet;
+  SSL_DetectionFrame *d = packet.mutable_detection();
+  d->set_frame_number(frame);
+  d->set_t_capture(t);
+  d->set_t_sent(t + .002);
+  d->set_camera_id(camera);
+
+  SSL_DetectionBall *b = d->add_balls();
+  b->set_confidence(.9);
+  b->set_x(1000 * cos(t));
+  b->set_y(800 * sin(t));
+  b->set_pixel_x(0);
+  b->set_pixel_y(0);
+
+  for (int id = 0; id < SynthRobotsPerTeam; id++) {
+    SynthRobot(d->add_robots_blue(), id, -2000 + 400 * id + 100 * sin(t + id), -1000 + 50 * cos(t));
+    SynthRobot(d->add_robots_yellow(), id, -2000 + 400 * id + 100 * cos(t + id), 1000 + 50 * sin(t));
+  }
+  return packet;
+}
+
+inline SSL_WrapperPacket SynthGeometry()
+{
+  SSL_WrapperPacket packet;
+  SSL_GeometryFieldSize *f = packet.mutable_geometry()->mutable_field();
+  f->set_field_length(12000);
+  f->set_field_width(9000);
+  f->set_goal_width(1200);
+  f->set_goal_depth(180);
+  f->set_boundary_width(300);
+  for (int i = 0; i < 10; i++) {
+    SSL_FieldLineSegment *l = f->add_field_lines();
+    l->set_name("line " + std::to_string(i));
+    l->mutable_p1()->set_x(-6000);
+    l->mutable_p1()->set_y(100 * i);
+    l->mutable_p2()->set_x(6000);
+    l->mutable_p2()->set_y(100 * i);
+    l->set_thickness(10);
+  }
+  for (int c = 0; c < SynthCameras; c++) {
+    SSL_GeometryCameraCalibration *cal = packet.mutable_geometry()->add_calib();
+    cal->set_camera_id(c);
+    cal->set_focal_length(500);
+    cal->set_principal_point_x(300);
+    cal->set_principal_point_y(200);
+    cal->set_distortion(0);
+    cal->set_q0(0);
+    cal->set_q1(0);
+    cal->set_q2(0);
+    cal->set_q3(1);
+    cal->set_tx(0);
+    cal->set_ty(0);
+    cal->set_tz(4000);
+  }
+  return packet;
+}
+
+inline void SynthTeam(SSL_Referee::TeamInfo *t, const char *name)
+{
+  t->set_name(name);
+  t->set_score(0);
+  t->set_red_cards(0);
+  t->set_yellow_cards(0);
+  t->set_timeouts(4);
+  t->set_timeout_time(300000000);
+  t->set_goalie(0);
+}
+
+inline SSL_Referee SynthReferee(double t)
+{
+  SSL_Referee ref;
+  ref.set_packet_timestamp(static_cast<uint64_t>(t * 1e6));
+  ref.set_stage(SSL_Referee::NORMAL_FIRST_HALF);
+  ref.set_stage_time_left(static_cast<int>((300 - t) * 1e6));
+  ref.set_command(SSL_Referee::NORMAL_START);
+  ref.set_command_counter(3);
+  ref.set_command_timestamp(1000000);
+  SynthTeam(ref.mutable_yellow(), "yellow");
+  SynthTeam(ref.mutable_blue(), "blue");
+  ref.set_blue_team_on_positive_half(true);
+  return ref;
+}
+
+// worlds at 60 Hz in which the ball circles the field and each team's robots
+// spread across its length, turning and sweeping between the touch lines
+// (in and out of the defense areas)
+inline std::vector<World> SynthWorlds(int frames, int robots_per_team)
+{
+  std::vector<World> worlds(frames);
+  float spacing = 11000.f / robots_per_team;
+  for (int f = 0; f < frames; f++) {
+    double t = f / 60.0;
+    World &w = worlds[f];
+    w.reset();
+    w.time = t;
+    w.ball.conf = .9;
+    w.ball.loc.set(4000 * cos(t), 3000 * sin(.7 * t));
+    for (int team = 0; team < NumTeams; team++) {
+      for (int id = 0; id < robots_per_team; id++) {
+        WorldRobot r;
+        r.conf = .9;
+        r.robot_id.set(static_cast<Team>(team), id);
+        r.loc.set(-5500 + spacing * id + 300 * sin(t + id), (team ? 1 : -1) * (300 + 2500 * cos(.3 * t + id)));
+        r.angle = t + id;
+        w.robots.insert(r);
+      }
+    }
+  }
+  return worlds;
+}
+
+// mean time of frame(w) over the worlds, in ns; frame returns a number,
+// which is only summed to keep the work from being optimized away
+template <typename F>
+double NsPerFrame(const std::vector<World> &worlds, F frame)
+{
+  double sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const World &w : worlds) {
+    sink += frame(w);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  if (sink == 42) {
+    puts("");
+  }
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / worlds.size();
+}
@@ -0,0 +1,222 @@
+// Times touch detection on a synthetic match in which the ball is passed
+// between stationary robots, done either by the Accel, BackTrack and
+// RobotDist processors in turn (taking the first that fires, as
+// BallTouchedEvent used to) or by a TouchEngine, and checks each report
+// against the touches the match was made from: whether it blames the right
+// robot, and how far off its time and location (for the processors, the
+// ball's location when the touch is reported) are.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "constants.h"
+#include "legacy_touches.h"
+#include "touches.h"
+#include "world_history.h"
+
+static const int Frames = 20000;
+static const int RobotsPerTeam = 8;
+static const double BallSpeed = 3000;
+static const double NoiseSigma = 2;
+
+struct TrueTouch
+{
+  RobotID robot_id;
+  double time;
+  vector2f loc;
+};
+
+struct Match
+{
+  std::vector<World> worlds;
+  std::vector<TrueTouch> touches;
+};
+
+static Match makeMatch()
+{
+  Match m;
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0, NoiseSigma);
+
+  World base;
+  base.reset();
+  std::vector<WorldRobot> robots;
+  for (int team = 0; team < NumTeams; team++) {
+    for (int id = 0; id < RobotsPerTeam; id++) {
+      WorldRobot r;
+      r.conf = .9;
+      r.robot_id.set(static_cast<Team>(team), id);
+      r.loc.set(-3500 + 1000 * id, (team ? 1 : -1) * (800 + 600 * (id % 3)));
+      robots.push_back(r);
+    }
+  }
+
+  // the ball leaves the robot it last touched towards a random other one,
+  // at a constant speed, and bounces off it on contact
+  float contact = Constants::MaxRobotRadius + Constants::BallRadius;
+  int at = 0;
+  vector2f from = robots[at].loc + vector2f(contact, 0);
+  double t_from = 0;
+  int to = 1;
+  vector2f aim = robots[to].loc + (from - robots[to].loc).norm() * contact;
+  double t_to = dist(from, aim) / BallSpeed;
+
+  for (int f = 0; f < Frames; f++) {
+    double t = f / Constants::FrameRate;
+    while (t >= t_to) {
+      m.touches.push_back({robots[to].robot_id, t_to, aim});
+      at = to;
+      from = aim;
+      t_from = t_to;
+      do {
+        to = std::uniform_int_distribution<int>(0, robots.size() - 1)(rng);
+      } while (to == at);
+      aim = robots[to].loc + (from - robots[to].loc).norm() * contact;
+      t_to = t_from + dist(from, aim) / BallSpeed;
+    }
+
+    World w = base;
+    w.time = t;
+    w.ball.conf = .9;
+    double c = (t - t_from) / (t_to - t_from);
+    w.ball.loc = (1 - c) * from + c * aim + vector2f(noise(rng), noise(rng));
+    for (WorldRobot r : robots) {
+      r.loc += vector2f(noise(rng), noise(rng));
+      w.robots.insert(r);
+    }
+    m.worlds.push_back(w);
+  }
+  return m;
+}
+
+struct Report
+{
+  RobotID robot_id;
+  double time;
+  vector2f loc;
+};
+
+struct Result
+{
+  double ns_per_frame;
+  int reports, correct;
+
+  // over the first correct report of each touch (later ones are just the
+  // same touch seen again): the median and 90th percentile errors in time
+  // (ms) and location (mm)
+  double time_p50, time_p90, loc_p50, loc_p90;
+};
+
+static double percentile(std::vector<double> v, double p)
+{
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[std::min<size_t>(v.size() - 1, p * v.size())];
+}
+
+// runs detect(history, report) on each frame, which returns whether it
+// reports a touch; a report is correct if the last touch within the
+// previous 200 ms was by the robot blamed
+template <typename Detect>
+static Result run(const Match &m, Detect detect)
+{
+  WorldHistory history;
+  std::vector<Report> reports(m.worlds.size());
+  std::vector<char> reported(m.worlds.size());
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t f = 0; f < m.worlds.size(); f++) {
+    history.add(m.worlds[f]);
+    reported[f] = detect(history, reports[f]);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  Result res{std::chrono::duration<double, std::nano>(t1 - t0).count() / m.worlds.size(), 0, 0, 0, 0, 0, 0};
+  std::vector<double> time_err, loc_err;
+  size_t next = 0, last_matched = 0;
+  for (size_t f = 0; f < m.worlds.size(); f++) {
+    double t = m.worlds[f].time;
+    while (next < m.touches.size() && m.touches[next].time <= t) {
+      next++;
+    }
+    if (!reported[f]) {
+      continue;
+    }
+    res.reports++;
+    if (next > 0 && t - m.touches[next - 1].time < .2 && m.touches[next - 1].robot_id == reports[f].robot_id) {
+      const TrueTouch &touch = m.touches[next - 1];
+      res.correct++;
+      if (last_matched != next) {
+        last_matched = next;
+        time_err.push_back(1000 * fabs(reports[f].time - touch.time));
+        loc_err.push_back(dist(reports[f].loc, touch.loc));
+      }
+    }
+  }
+  res.time_p50 = percentile(time_err, .5);
+  res.time_p90 = percentile(time_err, .9);
+  res.loc_p50 = percentile(loc_err, .5);
+  res.loc_p90 = percentile(loc_err, .9);
+  return res;
+}
+
+int main()
+{
+  Constants::initDivisionA();
+  Match m = makeMatch();
+
+  printf("%d frames, %d robots, %zu touches\n", Frames, NumTeams * RobotsPerTeam, m.touches.size());
+  printf("%-12s %10s %10s %10s %10s %10s %10s %10s\n",
+         "",
+         "ns/frame",
+         "reports",
+         "correct",
+         "t50 (ms)",
+         "t90 (ms)",
+         "loc50 (mm)",
+         "loc90 (mm)");
+
+  auto print = [](const char *name, const Result &r) {
+    printf("%-12s %10.0f %10d %10d %10.2f %10.2f %10.1f %10.1f\n",
+           name,
+           r.ns_per_frame,
+           r.reports,
+           r.correct,
+           r.time_p50,
+           r.time_p90,
+           r.loc_p50,
+           r.loc_p90);
+  };
+
+  std::vector<std::unique_ptr<TouchProcessor>> procs;
+  procs.emplace_back(new AccelProcessor());
+  procs.emplace_back(new BackTrackProcessor());
+  procs.emplace_back(new RobotDistProcessor());
+  print("processors", run(m, [&](const WorldHistory &history, Report &report) {
+          CollideResult res;
+          for (auto &proc : procs) {
+            if (proc->proc(history, res)) {
+              report = {res.robot_id, res.time, history.ball(0).loc};
+              return true;
+            }
+          }
+          return false;
+        }));
+
+  TouchEngine engine;
+  print("engine", run(m, [&](const WorldHistory &history, Report &report) {
+          TouchEngine::Touch touch;
+          if (engine.update(history, touch)) {
+            report = {touch.robot_id, touch.time, touch.loc};
+            return true;
+          }
+          return false;
+        }));
+}
@@ -11,6 +11,7 @@
 #include "ssl_referee.pb.h"
 
 #include "base_ref.h"
+#include "event_pipeline.h"
 
 #include "constants.h"
 #include "events.h"
@@ -19,11 +20,32 @@
 
 using namespace google::protobuf;
 
+// the events, in the order they are processed
+using EvaluationEvents = EventPipeline<RefboxUpdateEvent,
+                                       KickTakenEvent,
+                                       BallSpeedEvent,
+                                       GoalScoredEvent,
+                                       BallExitEvent,
+                                       BallTouchedEvent,
+                                       LongDribbleEvent,
+                                       TooManyRobotsEvent,
+                                       RobotSpeedEvent,
+                                       StopDistanceEvent,
+                                       BallStuckEvent>;
+
 class EvaluationAutoref : public BaseAutoref
 {
+  EvaluationEvents pipeline;
+
   bool doEvents(const World &w, bool ball_z_valid = false, float ball_z = 0);
   bool verbose;
 
 public:
   EvaluationAutoref(bool verbose_);
+
+  template <typename E>
+  E &event()
+  {
+    return pipeline.get<E>();
+  }
 };
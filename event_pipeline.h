@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+#include "events.h"
+
+// what EventPipeline::run does with each event
+enum EventStep
+{
+  SKIP_EVENT,
+  PROCESS_EVENT,
+  // it has already been processed (see speculate), so only call after
+  EVENT_PROCESSED,
+};
+
+// A fixed set of events given as a type list, e.g. EventPipeline<InitEvent,
+// KickReadyEvent, ...>. The events are stored contiguously in a tuple rather
+// than allocated one by one, get<E>() is resolved at compile time, and run()
+// calls each event's _process directly rather than through the vtable, so
+// the compiler can inline it.
+template <typename... Events>
+class EventPipeline
+{
+  template <typename>
+  using RefArg = BaseAutoref *;
+
+  std::tuple<Events...> events;
+
+  // the Independent events as they were before speculate() started them
+  std::tuple<Events...> saved;
+
+  template <typename E>
+  static void process(E &ev, const World &w, bool ball_z_valid, float ball_z)
+  {
+    if (ev.beginProcess()) {
+      ev.E::_process(w, ball_z_valid, ball_z);
+    }
+  }
+
+  template <size_t I, typename Dispatch, typename After>
+  bool runOne(const World &w, bool ball_z_valid, float ball_z, Dispatch &dispatch, After &after)
+  {
+    EventStep step = dispatch(static_cast<int>(I));
+    if (step == SKIP_EVENT) {
+      return false;
+    }
+    auto &ev = std::get<I>(events);
+    if (step == PROCESS_EVENT) {
+      process(ev, w, ball_z_valid, ball_z);
+    }
+    return after(static_cast<int>(I), &ev);
+  }
+
+  template <size_t... I, typename Dispatch, typename After>
+  bool run(std::index_sequence<I...>,
+           const World &w,
+           bool ball_z_valid,
+           float ball_z,
+           Dispatch &dispatch,
+           After &after)
+  {
+    // in order, stopping at the first event for which after returns true
+    return (runOne<I>(w, ball_z_valid, ball_z, dispatch, after) || ...);
+  }
+
+  template <size_t I, typename Start, typename Spawn>
+  uint64_t speculateOne(
+    const AutorefVariables &vars, const World &w, bool ball_z_valid, float ball_z, Start &start, Spawn &spawn)
+  {
+    using E = std::tuple_element_t<I, std::tuple<Events...>>;
+    if constexpr (E::Independent) {
+      if (start(static_cast<int>(I))) {
+        E &ev = std::get<I>(events);
+        E &save = std::get<I>(saved);
+        spawn(static_cast<int>(I), [&ev, &save, &vars, &w, ball_z_valid, ball_z]() {
+          save = ev;
+          if (ev.beginProcess(vars)) {
+            ev.E::_process(w, ball_z_valid, ball_z);
+          }
+        });
+        return uint64_t(1) << I;
+      }
+    }
+    return 0;
+  }
+
+  template <size_t... I, typename Start, typename Spawn>
+  uint64_t speculate(std::index_sequence<I...>,
+                     const AutorefVariables &vars,
+                     const World &w,
+                     bool ball_z_valid,
+                     float ball_z,
+                     Start &start,
+                     Spawn &spawn)
+  {
+    return (speculateOne<I>(vars, w, ball_z_valid, ball_z, start, spawn) | ... | 0);
+  }
+
+  template <size_t I>
+  void restoreOne()
+  {
+    using E = std::tuple_element_t<I, std::tuple<Events...>>;
+    if constexpr (E::Independent) {
+      std::get<I>(events) = std::get<I>(saved);
+    }
+  }
+
+  template <size_t... I>
+  void restoreAt(int i, std::index_sequence<I...>)
+  {
+    ((static_cast<int>(I) == i ? restoreOne<I>() : void()), ...);
+  }
+
+public:
+  static const int Size = sizeof...(Events);
+
+  explicit EventPipeline(BaseAutoref *ref) : events(RefArg<Events>(ref)...), saved(RefArg<Events>(ref)...)
+  {
+  }
+
+  template <typename E>
+  E &get()
+  {
+    return std::get<E>(events);
+  }
+
+  // calls f on each event, as its own type, in order
+  template <typename F>
+  void forEach(F f)
+  {
+    std::apply([&](Events &... ev) { (f(ev), ...); }, events);
+  }
+
+  // goes through the events in order, doing with each event i what
+  // dispatch(i) says and then calling after(i, event) if it was processed;
+  // stops and returns true as soon as after does. dispatch is called just
+  // before each event, so it can depend on what the events before it did.
+  template <typename Dispatch, typename After>
+  bool run(const World &w, bool ball_z_valid, float ball_z, Dispatch dispatch, After after)
+  {
+    return run(std::index_sequence_for<Events...>(), w, ball_z_valid, ball_z, dispatch, after);
+  }
+
+  // for each Independent event i for which start(i) is true, calls
+  // spawn(i, task), where task saves the event's state and then processes
+  // it starting from vars (which, like w, must stay alive and unchanged
+  // until all the tasks have run). Returns the events started, as a mask.
+  template <typename Start, typename Spawn>
+  uint64_t speculate(
+    const AutorefVariables &vars, const World &w, bool ball_z_valid, float ball_z, Start start, Spawn spawn)
+  {
+    return speculate(std::index_sequence_for<Events...>(), vars, w, ball_z_valid, ball_z, start, spawn);
+  }
+
+  // puts event i back as it was before its speculate task ran
+  void restore(int i)
+  {
+    restoreAt(i, std::index_sequence_for<Events...>());
+  }
+};
@@ -4,6 +4,7 @@
 
 #include "base_ref.h"
 #include "constants.h"
+#include "field_model.h"
 #include "geomalgo.h"
 #include "util.h"
 
@@ -94,6 +95,21 @@ const AutorefVariables &AutorefEvent::refVars() const
   return ref->vars;
 }
 
+const WorldHistory &AutorefEvent::history() const
+{
+  return ref->world_history;
+}
+
+const WorldFeatures &AutorefEvent::features() const
+{
+  return ref->world_features;
+}
+
+const LinearFit<5> &AutorefEvent::ballFit() const
+{
+  return ref->ball_fit;
+}
+
 vector2f legalPosition(vector2f loc)
 {
   if (fabs(loc.x) > C::FieldLengthH) {
@@ -257,6 +273,10 @@ void BallSpeedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     last_loc = w.ball.loc;
     return;
   }
+  // the speed needs time to have passed since the last world
+  if (w.time <= last_time) {
+    return;
+  }
 
   last_locs.push_back(w.ball.loc);
   if (last_locs.size() > 5) {
@@ -269,7 +289,7 @@ void BallSpeedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     speed_hist.pop_front();
   }
 
-  if (speed > C::MaxKickSpeed * 1.02) {
+  if (speed > C::MaxKickSpeed * 1.02 && w.ball.speedSigma() < MaxSpeedSigma) {
     cnt++;
   }
   else {
@@ -287,9 +307,9 @@ void BallSpeedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     vars.state = REF_WAIT_STOP;
     setDescription("Ball kicked too fast (%.3f m/s) by %s team", speed / 1000, TeamName(vars.toucher.team));
 
-    puts("speed history:");
+    note("speed history:\n");
     for (double s : speed_hist) {
-      printf("- %.3f\n", s / 1000);
+      note("- %.3f\n", s / 1000);
     }
 
     {
@@ -373,13 +393,17 @@ void BallExitEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     if (w.ball.visible()) {
       lost_cnt = 0;
       ball_loc = w.ball.loc;
-      ball_history.add(tvec(w.time, ball_loc));
     }
     else {
       lost_cnt++;
 
-      vector2f p0, v0;
-      linvel(ball_history, p0, v0);
+      const LinearFit<5> &ball_history = ballFit();
+      if (ball_history.size() < 2) {
+        return;
+      }
+
+      vector2f p0 = ball_history.position(ball_history[-ball_history.size() + 1].t);
+      vector2f v0 = ball_history.velocity();
 
       frames = min(lost_cnt, MAX_EXTRAPOLATE_FRAMES);
       ball_loc = p0 + v0 * C::FramePeriod * (frames + ball_history.size() - 1);
@@ -389,9 +413,10 @@ void BallExitEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     ball_loc = w.ball.loc;
   }
 
-  bool f = !IsInField(ball_loc + 0 * (ball_loc - last_ball_loc), -C::BallRadius, false);
+  // the observed ball is classified once per frame for all events
+  bool in_field = (frames == 0) ? features().ballInField() : IsInField(ball_loc, -C::BallRadius, false);
 
-  if (f) {
+  if (!in_field) {
     cnt++;
   }
   else {
@@ -467,7 +492,7 @@ void BallExitEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     }
   }
 
-  if (IsInField(ball_loc, -C::BallRadius, false)) {
+  if (in_field) {
     last_ball_loc = ball_loc;
   }
 }
@@ -476,19 +501,18 @@ const char BallTouchedEvent::ID;
 
 void BallTouchedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 {
-  {
-    CollideResult res;
-    for (auto &proc : procs) {
-      if (proc->proc(w, res)) {
-        fired = true;
-        vars.toucher = res.robot_id;
-        vars.touch_loc = w.ball.loc;
-        vars.touch_time = res.time;
-        setDescription(
-          "%.3f Ball touched by %s %X [%s]", w.time, TeamName(vars.toucher.team), res.robot_id.id, proc->name());
-        break;
-      }
-    }
+  TouchEngine::Touch touch;
+  if (touches.update(history(), touch)) {
+    fired = true;
+    vars.toucher = touch.robot_id;
+    vars.touch_loc = touch.loc;
+    vars.touch_time = touch.time;
+    setDescription("%.3f Ball touched by %s %X [%s %.2f]",
+                   w.time,
+                   TeamName(vars.toucher.team),
+                   touch.robot_id.id,
+                   TouchEngine::methodNames(touch.methods).c_str(),
+                   touch.confidence);
   }
 
   if (fired && vars.state == REF_RUN) {
@@ -497,13 +521,11 @@ void BallTouchedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     drawings.push_back(drawing.drawing);
 
     // check if the robot touched the ball while in one of the defense areas
-    for (const auto &r : w.robots) {
-      if (r.robot_id != vars.toucher) {
-        continue;
-      }
+    if (const WorldRobot *toucher = w.robot(vars.toucher)) {
+      const WorldRobot &r = *toucher;
 
       bool own_side_positive_x = (vars.blue_side > 0) == (r.robot_id.team == TeamBlue);
-      double own_dist = DistToDefenseArea(r.loc, own_side_positive_x);
+      double own_dist = features().defenseDist(r, own_side_positive_x);
       auto &refbox = ref->getRefboxMessage();
       uint32_t goalie_id = (vars.toucher.team == TeamBlue ? refbox.blue() : refbox.yellow()).goalie();
 
@@ -565,7 +587,7 @@ void BallTouchedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
         }
       }
       // check opponent defense area
-      if (DistToDefenseArea(r.loc, !own_side_positive_x) < C::MaxRobotRadius) {
+      if (features().defenseDist(r, !own_side_positive_x) < C::MaxRobotRadius) {
         vars.state = REF_WAIT_STOP;
         vars.kicker.team = FlipTeam(vars.toucher.team);
         vars.cmd = SSL_Referee::STOP;
@@ -688,8 +710,8 @@ void KickTakenEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 
   if (fired) {
     RobotID offender = checkDefenseAreaDistanceInfraction(w);
-    printf("kicker: %d %d\n", vars.kicker.team, vars.kicker.id);
-    printf("infraction: %d %d\n", offender.team, offender.id);
+    note("kicker: %d %d\n", vars.kicker.team, vars.kicker.id);
+    note("infraction: %d %d\n", offender.team, offender.id);
     if (offender.isValid()) {
       vars.state = REF_WAIT_STOP;
       vars.kicker.team = FlipTeam(vars.kicker.team);
@@ -701,13 +723,7 @@ void KickTakenEvent::_process(const World &w, bool ball_z_valid, float ball_z)
       autoref_msg_valid = true;
       setReplayTimes(w.time - 2, w.time);
       setEventRobot(SSL_Referee_Game_Event::ATTACKER_TO_DEFENCE_AREA, offender);
-      WorldRobot off;
-      for (const auto &r : w.robots) {
-        if (r.robot_id == offender) {
-          off = r;
-          break;
-        }
-      }
+      const WorldRobot &off = *w.robot(offender);
       setDesignatedPoint(legalPosition(off.loc));
 
       DrawingFrameWrapper drawing(w.time - 1, w.time + 1);
@@ -733,7 +749,7 @@ RobotID KickTakenEvent::checkDefenseAreaDistanceInfraction(const World &w) const
       continue;
     }
 
-    if (DistToDefenseArea(robot.loc, positive_x) < C::MaxRobotRadius + 200) {
+    if (features().defenseDist(robot, positive_x) < C::MaxRobotRadius + 200) {
       return robot.robot_id;
     }
   }
@@ -742,6 +758,12 @@ RobotID KickTakenEvent::checkDefenseAreaDistanceInfraction(const World &w) const
 
 const char KickExpiredEvent::ID;
 
+double KickExpiredEvent::nextDeadline() const
+{
+  const AutorefVariables &v = refVars();
+  return (v.state == REF_WAIT_KICK) ? v.kick_deadline : 0;
+}
+
 void KickExpiredEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 {
   if (vars.state == REF_WAIT_KICK && w.time > vars.kick_deadline) {
@@ -781,14 +803,18 @@ void GoalScoredEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     if (w.ball.visible()) {
       lost_cnt = 0;
       ball_loc = w.ball.loc;
-      ball_history.add(tvec(w.time, ball_loc));
     }
     // otherwise, project the last several positions forward
     else {
       lost_cnt++;
 
-      vector2f p0, v0;
-      linvel(ball_history, p0, v0);
+      const LinearFit<5> &ball_history = ballFit();
+      if (ball_history.size() < 2) {
+        return;
+      }
+
+      vector2f p0 = ball_history.position(ball_history[-ball_history.size() + 1].t);
+      vector2f v0 = ball_history.velocity();
 
       frames = min(lost_cnt, MAX_EXTRAPOLATE_FRAMES);
       ball_loc = p0 + v0 * (frames + ball_history.size() - 1) * C::FramePeriod;
@@ -796,8 +822,8 @@ void GoalScoredEvent::_process(const World &w, bool ball_z_valid, float ball_z)
       vector2f b(ball_loc.x, fabs(ball_loc.y));
       vector2f h(ball_history[0].v.x, fabs(ball_history[0].v.y));
       // check if the hallucinated trajectory crosses a goal wall
-      if (segment_intersects(
-            b, h, vector2f(C::FieldLengthH, C::GoalWidthH), vector2f(C::FieldLengthH + C::GoalDepth, C::GoalWidthH))) {
+      const FieldModel::Box &goal = FieldModel::get().goals[1];
+      if (segment_intersects(b, h, vector2f(goal.x_min, goal.y_max), vector2f(goal.x_max, goal.y_max))) {
         return;
       }
     }
@@ -806,8 +832,7 @@ void GoalScoredEvent::_process(const World &w, bool ball_z_valid, float ball_z)
     ball_loc = w.ball.loc;
   }
 
-  fired = ((fabs(ball_loc.y) < Constants::GoalWidthH) && (fabs(ball_loc.x) > C::FieldLengthH)
-           && (fabs(ball_loc.x) < C::FieldLengthH + Constants::GoalDepth));
+  fired = (frames == 0) ? features().ballInGoal() : IsInGoal(ball_loc);
 
   if (fired) {
     int x_sign = sign(ball_loc.x);
@@ -841,14 +866,26 @@ void GoalScoredEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 
 const char DelayDoneEvent::ID;
 
+double DelayDoneEvent::nextDeadline() const
+{
+  if (refVars().state != REF_DELAY_GOAL || t_start == 0) {
+    return 0;
+  }
+  return t_start + DelayFrames * C::FramePeriod;
+}
+
 void DelayDoneEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 {
   if (vars.state != REF_DELAY_GOAL) {
-    cnt = 0;
+    t_start = 0;
     return;
   }
 
-  fired = cnt++ > 10;
+  if (t_start == 0) {
+    t_start = w.time;
+  }
+
+  fired = w.time - t_start >= DelayFrames * C::FramePeriod;
   if (fired) {
     vars.state = REF_WAIT_STOP;
     vars.cmd = teamCommand(GOAL, FlipTeam(vars.kicker.team));
@@ -875,7 +912,7 @@ void LongDribbleEvent::_process(const World &w, bool ball_z_valid, float ball_z)
       continue;
     }
 
-    vector2f ball_local = (ball.loc - r.loc).rotate(-r.angle);
+    vector2f ball_local = features().ballLocal(r);
     DribbleRecord &d = dribble[r.robot_id.team][r.robot_id.id];
 
     double InX = C::DribblerOffset;
@@ -921,6 +958,11 @@ void LongDribbleEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 
 const char StageTimeEndedEvent::ID;
 
+double StageTimeEndedEvent::nextDeadline() const
+{
+  return refVars().stage_end;
+}
+
 void StageTimeEndedEvent::_process(const World &w, bool ball_z_valid, float ball_z)
 {
   if (vars.stage_end <= 0 || w.time < vars.stage_end) {
@@ -960,7 +1002,7 @@ const char TooManyRobotsEvent::ID;
 
 char *id_str(const World &w, Team team)
 {
-  static char id_str[500];
+  static thread_local char id_str[500];
   id_str[0] = 0;
   for (const auto &r : w.robots) {
     if (r.robot_id.team == team) {
@@ -1077,7 +1119,7 @@ void StopDistanceEvent::_process(const World &w, bool ball_z_valid, float ball_z
   float dist = GameOffRobotDistanceLimit + C::MaxRobotRadius;
 
   for (const auto &robot : w.robots) {
-    if ((robot.loc - w.ball.loc).length() < dist) {
+    if (features().ballDist(robot) < dist) {
       violation_frames[static_cast<int>(robot.robot_id.team)]++;
     }
   }
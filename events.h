@@ -8,7 +8,7 @@
 #include <cstdarg>
 
 #include "constants.h"
-#include "runqueue.h"
+#include "world_features.h"
 #include "touches.h"
 #include "util.h"
 #include "world.h"
@@ -30,6 +30,24 @@ enum RefGameState
 
 extern const char *ref_state_names[];
 
+// sets of game states and stages, as bit masks indexed by RefGameState and
+// SSL_Referee::Stage values
+static const uint32_t AllStates = (1u << NUM_REF_STATES) - 1;
+static const uint32_t AllStages = (1u << SSL_Referee::Stage_ARRAYSIZE) - 1;
+
+constexpr uint32_t StateBit(RefGameState s)
+{
+  return 1u << s;
+}
+constexpr uint32_t StageBit(SSL_Referee::Stage s)
+{
+  return 1u << s;
+}
+
+// the stages in which the ball is in play
+static const uint32_t PlayStages = StageBit(SSL_Referee::NORMAL_FIRST_HALF) | StageBit(SSL_Referee::NORMAL_SECOND_HALF)
+                                   | StageBit(SSL_Referee::EXTRA_FIRST_HALF) | StageBit(SSL_Referee::EXTRA_SECOND_HALF);
+
 struct AutorefVariables
 {
   RefGameState state;
@@ -42,6 +60,8 @@ struct AutorefVariables
   double kick_deadline;
 
   RobotID kicker;
+  // the robot that last touched the ball, when, and where the ball was then
+  // (the point of contact, where it could be found)
   RobotID toucher;
   double touch_time;
 
@@ -94,15 +114,57 @@ protected:
   bool autoref_msg_valid;
   std::vector<DrawingFrame> drawings;
 
+  // text for the engine to print after this processing
+  string notes;
+
   bool isEnabled()
   {
     return enabled;
   }
 
+  // the part of process() before _process, starting from the given vars;
+  // returns whether to call _process
+  bool beginProcess(const AutorefVariables &start_vars)
+  {
+    fired_last = fired;
+    fired = false;
+
+    if (!enabled) {
+      return false;
+    }
+
+    vars = start_vars;
+    game_event.Clear();
+    autoref_msg_valid = false;
+    drawings.clear();
+    notes.clear();
+    return true;
+  }
+  bool beginProcess()
+  {
+    return beginProcess(refVars());
+  }
+
+  template <typename... Events>
+  friend class EventPipeline;
+
   virtual void _process(const World &w, bool ball_z_valid, float ball_z) = 0;
+  virtual void _suspend()
+  {
+  }
 
   const AutorefVariables &refVars() const;
 
+  // the recent worlds, including the one being processed
+  const WorldHistory &history() const;
+
+  // cached geometry of the world being processed
+  const WorldFeatures &features() const;
+
+  // the ball's motion over the most recent of history() (up to 5) in which
+  // it was visible
+  const LinearFit<5> &ballFit() const;
+
   void setDescription(const char *format, ...)
   {
     va_list al;
@@ -111,6 +173,17 @@ protected:
     va_end(al);
   }
 
+  // prints to the engine's output once the engine has taken this
+  // processing's results (not directly, which could interleave with other
+  // events' output when Independent)
+  void note(const char *format, ...)
+  {
+    va_list al;
+    va_start(al, format);
+    notes += StringFormat(format, al);
+    va_end(al);
+  }
+
   void setReplayTimes(double t0, double t1)
   {
     // TODO (old format with replays was removed)
@@ -143,6 +216,13 @@ protected:
   }
 
 public:
+  // set to true in subclasses whose _process reads only its arguments, its
+  // own members (including vars, but not refVars()), history(), features()
+  // and the refbox message, and writes only its own members; the engine can
+  // then process it on another thread alongside the events before it (see
+  // BaseAutoref::setRuleThreads)
+  static const bool Independent = false;
+
   std::vector<DrawingFrame> getDrawings()
   {
     return drawings;
@@ -150,18 +230,19 @@ public:
 
   void process(const World &w, bool ball_z_valid, float ball_z)
   {
-    fired_last = fired;
-    fired = false;
-
-    if (!enabled) {
-      return;
+    if (beginProcess()) {
+      _process(w, ball_z_valid, ball_z);
     }
+  }
 
-    vars = refVars();
-    game_event.Clear();
-    autoref_msg_valid = false;
-    drawings.clear();
-    _process(w, ball_z_valid, ball_z);
+  // called by the engine instead of process() when the event stops being
+  // dispatched (see activeStates), so it is left as it would have been by
+  // process() returning early
+  void suspend()
+  {
+    fired_last = fired;
+    fired = false;
+    _suspend();
   }
 
   void setEnabled(bool e)
@@ -171,6 +252,24 @@ public:
 
   virtual const char *name() const = 0;
 
+  // the states and stages outside of which _process does nothing (beyond what
+  // _suspend does); the engine only dispatches the event while both match
+  virtual uint32_t activeStates() const
+  {
+    return AllStates;
+  }
+  virtual uint32_t activeStages() const
+  {
+    return AllStages;
+  }
+
+  // world time at which this event next needs to be processed even if no
+  // new vision frame arrives, or 0 if it only reacts to frames
+  virtual double nextDeadline() const
+  {
+    return 0;
+  }
+
   const AutorefVariables &getUpdate() const
   {
     return vars;
@@ -188,6 +287,10 @@ public:
   {
     return description;
   }
+  const string &getNotes() const
+  {
+    return notes;
+  }
 
   bool getMessage(SSL_Referee_Game_Event &msg) const
   {
@@ -215,6 +318,10 @@ public:
   {
     return "InitEvent";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_INIT);
+  }
 
   InitEvent(BaseAutoref *_ref) : AutorefEvent(_ref)
   {
@@ -251,6 +358,10 @@ public:
   {
     return "RobotsStartedEvent";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_WAIT_START);
+  }
 
   RobotsStartedEvent(BaseAutoref *_ref) : AutorefEvent(_ref), cnt(0)
   {
@@ -268,13 +379,26 @@ class BallSpeedEvent : public AutorefEvent
   vector2f last_loc;
   double last_time;
 
+  // frames where the ball filter is this unsure of the speed (e.g., the
+  // ball was just reacquired) do not count
+  constexpr static float MaxSpeedSigma = 1000;
+
 public:
   static const char ID = 0;
+  static const bool Independent = true;
   void _process(const World &w, bool ball_z_valid, float ball_z);
   const char *name() const
   {
     return "ball goes too fast";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_RUN);
+  }
+  uint32_t activeStages() const
+  {
+    return PlayStages;
+  }
 
   BallSpeedEvent(BaseAutoref *_ref) : AutorefEvent(_ref), cnt(0), last_loc(0, 0), last_time(0)
   {
@@ -295,6 +419,11 @@ public:
   {
     return "ball gets stuck in play";
   }
+  uint32_t activeStates() const
+  {
+    // _process currently returns right away
+    return 0;
+  }
 
   BallStuckEvent(BaseAutoref *_ref) : AutorefEvent(_ref), stuck_count(0), wait_frames(0), last_ball_loc(0, 0)
   {
@@ -303,7 +432,10 @@ public:
 
 class DelayDoneEvent : public AutorefEvent
 {
-  int cnt;
+  // how long to stay in the delay state, in frame periods
+  static const int DelayFrames = 11;
+
+  double t_start;
 
 public:
   static const char ID = 0;
@@ -312,15 +444,23 @@ public:
   {
     return "DelayDoneEvent";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_DELAY_GOAL);
+  }
+  void _suspend()
+  {
+    t_start = 0;
+  }
+  double nextDeadline() const;
 
-  DelayDoneEvent(BaseAutoref *_ref) : AutorefEvent(_ref), cnt(0)
+  DelayDoneEvent(BaseAutoref *_ref) : AutorefEvent(_ref), t_start(0)
   {
   }
 };
 
 class BallExitEvent : public AutorefEvent
 {
-  RunningQueue<tvec, 5> ball_history;
   int lost_cnt;
   int stop_cnt;
 
@@ -337,6 +477,14 @@ public:
   {
     return "ball exits the field";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_RUN);
+  }
+  uint32_t activeStages() const
+  {
+    return PlayStages;
+  }
 
   BallExitEvent(BaseAutoref *_ref)
       : AutorefEvent(_ref),
@@ -347,13 +495,12 @@ public:
         generator(std::chrono::system_clock::now().time_since_epoch().count()),
         binary_dist(0, 1)
   {
-    ball_history.init();
   }
 };
 
 class BallTouchedEvent : public AutorefEvent
 {
-  vector<TouchProcessor *> procs;
+  TouchEngine touches;
 
 public:
   static const char ID = 0;
@@ -365,9 +512,6 @@ public:
 
   BallTouchedEvent(BaseAutoref *_ref) : AutorefEvent(_ref)
   {
-    procs.push_back(new AccelProcessor());
-    procs.push_back(new BackTrackProcessor());
-    procs.push_back(new RobotDistProcessor());
   }
 };
 
@@ -384,6 +528,11 @@ public:
   {
     return "KickReadyEvent";
   }
+  uint32_t activeStages() const
+  {
+    return StageBit(SSL_Referee::NORMAL_FIRST_HALF_PRE) | StageBit(SSL_Referee::NORMAL_FIRST_HALF)
+           | StageBit(SSL_Referee::NORMAL_SECOND_HALF_PRE) | StageBit(SSL_Referee::NORMAL_SECOND_HALF);
+  }
 
   KickReadyEvent(BaseAutoref *_ref) : AutorefEvent(_ref), t0_bots(0), t0_ball(0)
   {
@@ -399,6 +548,10 @@ public:
   {
     return "a kick is taken";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_WAIT_KICK);
+  }
 
   KickTakenEvent(BaseAutoref *_ref) : AutorefEvent(_ref)
   {
@@ -416,6 +569,11 @@ public:
   {
     return "KickExpiredEvent";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_WAIT_KICK);
+  }
+  double nextDeadline() const;
 
   KickExpiredEvent(BaseAutoref *_ref) : AutorefEvent(_ref)
   {
@@ -424,7 +582,6 @@ public:
 
 class GoalScoredEvent : public AutorefEvent
 {
-  RunningQueue<tvec, 5> ball_history;
   int lost_cnt;
   int stop_cnt;
 
@@ -438,10 +595,17 @@ public:
   {
     return "a goal is scored";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_RUN);
+  }
+  uint32_t activeStages() const
+  {
+    return PlayStages;
+  }
 
   GoalScoredEvent(BaseAutoref *_ref) : AutorefEvent(_ref), last_ball_loc(0, 0), cnt(0), lost_cnt(0), stop_cnt(0)
   {
-    ball_history.init();
   }
 };
 
@@ -462,6 +626,7 @@ class LongDribbleEvent : public AutorefEvent
 
 public:
   static const char ID = 0;
+  static const bool Independent = true;
   void _process(const World &w, bool ball_z_valid, float ball_z);
   const char *name() const
   {
@@ -482,6 +647,7 @@ public:
   {
     return "StageTimeEndedEvent";
   }
+  double nextDeadline() const;
 
   StageTimeEndedEvent(BaseAutoref *_ref) : AutorefEvent(_ref)
   {
@@ -494,11 +660,16 @@ class TooManyRobotsEvent : public AutorefEvent
 
 public:
   static const char ID = 0;
+  static const bool Independent = true;
   void _process(const World &w, bool ball_z_valid, float ball_z);
   const char *name() const
   {
     return "a team has too many robots";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_RUN) | StateBit(REF_WAIT_STOP);
+  }
 
   TooManyRobotsEvent(BaseAutoref *_ref) : AutorefEvent(_ref), blue_frames(0), yellow_frames(0)
   {
@@ -515,11 +686,20 @@ class RobotSpeedEvent : public AutorefEvent
 
 public:
   static const char ID = 0;
+  static const bool Independent = true;
   void _process(const World &w, bool ball_z_valid, float ball_z);
   const char *name() const
   {
     return "a robot moves too fast during game off";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_WAIT_STOP);
+  }
+  void _suspend()
+  {
+    frames_in_stop = 0;
+  }
 
   RobotSpeedEvent(BaseAutoref *_ref) : AutorefEvent(_ref), frames_in_stop(0)
   {
@@ -535,11 +715,16 @@ class StopDistanceEvent : public AutorefEvent
 
 public:
   static const char ID = 0;
+  static const bool Independent = true;
   void _process(const World &w, bool ball_z_valid, float ball_z);
   const char *name() const
   {
     return "a robot is too close to the ball during game off";
   }
+  uint32_t activeStates() const
+  {
+    return StateBit(REF_WAIT_STOP);
+  }
 
   StopDistanceEvent(BaseAutoref *_ref) : AutorefEvent(_ref)
   {
@@ -0,0 +1,180 @@
+#include "ingest.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "util.h"
+
+Ingest::Ingest() : running(false), parse_errors(0), recorder(nullptr)
+{
+  notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+Ingest::~Ingest()
+{
+  stop();
+  if (notify_fd >= 0) {
+    close(notify_fd);
+  }
+}
+
+bool Ingest::openVision()
+{
+  return vision_net.open(VisionGroup, VisionPort, false);
+}
+
+bool Ingest::openReferee()
+{
+  return ref_net.open(RefGroup, RefPort, false);
+}
+
+void Ingest::start()
+{
+  if (running) {
+    return;
+  }
+  running = true;
+  thread = std::thread(&Ingest::run, this);
+}
+
+void Ingest::stop()
+{
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void Ingest::clearNotify()
+{
+  uint64_t v;
+  while (read(notify_fd, &v, sizeof(v)) > 0) {
+  }
+}
+
+void Ingest::record(LogRecordType type, const Datagram &d)
+{
+  if (recorder != nullptr) {
+    recorder->append(type, ntohs(d.src.getSockAddr().sin_port), d.recv_time, d.data, d.len);
+  }
+}
+
+void Ingest::markEvent(const char *name, double capture_time)
+{
+  if (recorder == nullptr) {
+    return;
+  }
+  EventMark *m = marks.beginPush();
+  if (m == nullptr) {
+    return;
+  }
+  m->name = name;
+  m->time = GetTimeMicros() / 1e6;
+  m->capture_time = capture_time;
+  marks.commitPush();
+}
+
+void Ingest::recordMarks()
+{
+  char buf[sizeof(LogEventMark) + 256];
+  for (EventMark *m = marks.front(); m != nullptr; marks.pop(), m = marks.front()) {
+    LogEventMark mark;
+    mark.capture_time = m->capture_time;
+    size_t len = std::min(strlen(m->name), sizeof(buf) - sizeof(mark));
+    memcpy(buf, &mark, sizeof(mark));
+    memcpy(buf + sizeof(mark), m->name, len);
+    recorder->append(LOG_EVENT, 0, m->time, buf, sizeof(mark) + len);
+  }
+}
+
+void Ingest::receive(UDP &net, IngestPacket::Source source, Datagram *batch)
+{
+  int n = net.recvBatch(batch);
+  int pushed = 0;
+  for (int i = 0; i < n; i++) {
+    const Datagram &d = batch[i];
+    IngestPacket *p = ring.beginPush();
+    if (p == nullptr) {
+      // ring is full: drop the packet (counted by the ring), but keep it in
+      // the recording
+      record(source == IngestPacket::VISION ? LOG_VISION : LOG_REFEREE, d);
+      continue;
+    }
+
+    {
+      LatencyProbe probe(parse_latency);
+      p->decoder.reset();
+      if (source == IngestPacket::VISION) {
+        p->vision = p->decoder.parseVision(d.data, d.len);
+        p->referee = nullptr;
+        p->content_hash = (p->vision != nullptr && p->vision->has_geometry()) ? GeometryHash(d.data, d.len) : 0;
+      }
+      else {
+        p->vision = nullptr;
+        p->referee = p->decoder.parseReferee(d.data, d.len);
+        p->content_hash = (p->referee != nullptr) ? RefereeHash(d.data, d.len) : 0;
+      }
+    }
+
+    if (source == IngestPacket::REFEREE) {
+      record(LOG_REFEREE, d);
+    }
+    else {
+      record((p->vision != nullptr && !p->vision->has_detection() && p->vision->has_geometry()) ? LOG_GEOMETRY
+                                                                                               : LOG_VISION,
+             d);
+    }
+
+    if (p->vision == nullptr && p->referee == nullptr) {
+      parse_errors.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    p->source = source;
+    p->recv_time = d.recv_time;
+    ring.commitPush();
+    pushed++;
+  }
+
+  if (pushed > 0) {
+    uint64_t one = 1;
+    if (write(notify_fd, &one, sizeof(one)) < 0) {
+      // counter saturated; the consumer is already signalled
+    }
+  }
+}
+
+void Ingest::run()
+{
+  Datagram batch[MaxRecvBatch];
+
+  pollfd pfds[2];
+  pfds[0].fd = vision_net.getFd();
+  pfds[0].events = POLLIN;
+  pfds[1].fd = ref_net.getFd();
+  pfds[1].events = POLLIN;
+
+  while (running) {
+    pfds[0].revents = pfds[1].revents = 0;
+    // wake up periodically to notice stop()
+    int ready = poll(pfds, 2, 100);
+    if (recorder != nullptr) {
+      recordMarks();
+    }
+    if (ready <= 0) {
+      continue;
+    }
+
+    if (pfds[0].revents & POLLIN) {
+      receive(vision_net, IngestPacket::VISION, batch);
+    }
+    if (pfds[1].revents & POLLIN) {
+      receive(ref_net, IngestPacket::REFEREE, batch);
+    }
+  }
+}
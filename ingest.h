@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "messages_robocup_ssl_wrapper.pb.h"
+#include "ssl_referee.pb.h"
+
+#include "decoder.h"
+#include "flight_log.h"
+#include "latency.h"
+#include "spsc_ring.h"
+#include "udp.h"
+
+// one parsed packet handed from the ingest thread to the autoref thread
+struct IngestPacket
+{
+  enum Source
+  {
+    VISION,
+    REFEREE,
+  };
+
+  Source source;
+
+  // kernel arrival time of the datagram, in seconds
+  double recv_time;
+
+  // only the message matching source is set; both live in this slot's
+  // arena, which is reset when the slot is reused
+  const SSL_WrapperPacket *vision;
+  const SSL_Referee *referee;
+
+  // content hash of the geometry (vision) or of the referee message without
+  // its timestamps (referee), for skipping unchanged content
+  uint64_t content_hash;
+
+  FrameDecoder decoder;
+
+  IngestPacket() : source(VISION), recv_time(0), vision(nullptr), referee(nullptr), content_hash(0)
+  {
+  }
+};
+
+// an autoref event that fired, to be written to the recording
+struct EventMark
+{
+  // event name (a string literal)
+  const char *name;
+  // wall-clock time when it fired, and capture time of its world
+  double time;
+  double capture_time;
+};
+
+// Receives and parses vision and referee packets on a dedicated thread, so
+// that slow work on the autoref thread (event processing, refbox round trips)
+// never holds up the sockets. Parsed packets are passed through a bounded
+// single-producer/single-consumer ring; getFd() becomes readable whenever new
+// packets have been pushed.
+class Ingest
+{
+public:
+  static const int RingSize = 128;
+  static const int MarkRingSize = 64;
+
+private:
+  UDP vision_net;
+  UDP ref_net;
+
+  SpscRing<IngestPacket, RingSize> ring;
+
+  std::thread thread;
+  std::atomic<bool> running;
+
+  // eventfd signalled by the ingest thread after pushing packets
+  int notify_fd;
+
+  std::atomic<uint64_t> parse_errors;
+
+  // time taken to parse each datagram (recorded by the ingest thread)
+  LatencyHistogram parse_latency;
+
+  // if set, every received datagram is appended to it on the ingest thread
+  FlightRecorder *recorder;
+
+  // event marks from the autoref thread, written to the recorder by the
+  // ingest thread so that it remains the only writer
+  SpscRing<EventMark, MarkRingSize> marks;
+
+  void run();
+  void receive(UDP &net, IngestPacket::Source source, Datagram *batch);
+  void record(LogRecordType type, const Datagram &d);
+  void recordMarks();
+
+public:
+  Ingest();
+  ~Ingest();
+
+  // open the sockets; must be called before start
+  bool openVision();
+  bool openReferee();
+
+  // must be called before start; the recorder is then owned by the ingest
+  // thread until stop
+  void setRecorder(FlightRecorder *recorder_)
+  {
+    recorder = recorder_;
+  }
+
+  // autoref thread: note in the recording that an event fired (dropped if
+  // there is no recorder or the mark ring is full)
+  void markEvent(const char *name, double capture_time);
+
+  void start();
+  void stop();
+
+  int getFd() const
+  {
+    return notify_fd;
+  }
+
+  // consumer side: call clearNotify when getFd() is readable, then take
+  // packets with front/pop until front returns nullptr
+  void clearNotify();
+  IngestPacket *front()
+  {
+    return ring.front();
+  }
+  void pop()
+  {
+    ring.pop();
+  }
+
+  uint64_t overflowCount() const
+  {
+    return ring.overflowCount();
+  }
+  int highWater() const
+  {
+    return ring.highWater();
+  }
+  int capacity() const
+  {
+    return ring.capacity();
+  }
+  uint64_t parseErrors() const
+  {
+    return parse_errors.load(std::memory_order_relaxed);
+  }
+  const LatencyHistogram &parseLatency() const
+  {
+    return parse_latency;
+  }
+};
@@ -1,6 +1,7 @@
 #include <netdb.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cctype>
 #include <cerrno>
 #include <cstdlib>
@@ -12,6 +13,7 @@
 #include <unordered_set>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -23,6 +25,7 @@
 // TODO set last id field
 
 #include "rconclient.h"
+#include "util.h"
 
 bool RemoteClient::recvFully(void *buffer, std::size_t length)
 {
@@ -67,6 +70,8 @@ SSL_RefereeRemoteControlRequest RemoteClient::createMessage()
 
 bool RemoteClient::sendRequest(const SSL_RefereeRemoteControlRequest &request)
 {
+  LatencyProbe probe(send_latency);
+
   // send request
   {
     const std::string &message = request.SerializeAsString();
@@ -113,8 +118,200 @@ bool RemoteClient::sendRequest(const SSL_RefereeRemoteControlRequest &request)
   return true;
 }
 
-bool RemoteClient::open(const char *hostname, int port)
+void RemoteClient::closeSocket()
+{
+  if (sock >= 0) {
+    close(sock);
+  }
+  sock = -1;
+  out_buf.clear();
+  out_pos = 0;
+  in_buf.clear();
+  if (!in_flight.empty()) {
+    std::cerr << in_flight.size() << " remote control requests lost without reply.\n";
+  }
+  in_flight.clear();
+}
+
+bool RemoteClient::queueRequest(const SSL_RefereeRemoteControlRequest &request, const RequestTag &tag)
+{
+  if (sock < 0) {
+    return false;
+  }
+  backlog.emplace_back();
+  InFlight &f = backlog.back();
+  f.request = request;
+  f.request.set_message_id(nextMessageID++);
+  f.tag = tag;
+  f.send_time = 0;
+  return true;
+}
+
+void RemoteClient::encodeBacklog()
 {
+  // keep at most MAX_IN_FLIGHT requests unanswered; the rest wait here
+  uint64_t now = GetTimeMicros();
+  while (!backlog.empty() && in_flight.size() < MAX_IN_FLIGHT) {
+    const SSL_RefereeRemoteControlRequest &request = backlog.front().request;
+    const std::string &message = request.SerializeAsString();
+    uint32_t messageLength = htonl(static_cast<uint32_t>(message.size()));
+    out_buf.append(reinterpret_cast<const char *>(&messageLength), sizeof(messageLength));
+    out_buf.append(message);
+
+    if (request.has_command()) {
+      std::cout << "Sending command: " << SSL_Referee::Command_Name(request.command()) << ".\n";
+    }
+    if (request.has_stage()) {
+      std::cout << "Sending stage: " << SSL_Referee::Stage_Name(request.stage()) << ".\n";
+    }
+
+    InFlight &f = in_flight[request.message_id()];
+    f = backlog.front();
+    f.send_time = now;
+    backlog.pop_front();
+  }
+}
+
+bool RemoteClient::onWritable()
+{
+  LatencyProbe probe(send_latency);
+
+  if (sock < 0) {
+    return false;
+  }
+
+  if (out_pos == out_buf.size()) {
+    out_buf.clear();
+    out_pos = 0;
+    encodeBacklog();
+  }
+
+  while (out_pos < out_buf.size()) {
+    ssize_t ret = send(sock, out_buf.data() + out_pos, out_buf.size() - out_pos, MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      std::cerr << std::strerror(errno) << '\n';
+      closeSocket();
+      return false;
+    }
+    out_pos += ret;
+  }
+  return true;
+}
+
+bool RemoteClient::onReadable()
+{
+  if (sock < 0) {
+    return false;
+  }
+
+  char buf[MAX_REPLY_LENGTH];
+  while (true) {
+    ssize_t ret = recv(sock, buf, sizeof(buf), 0);
+    if (ret < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      std::cerr << std::strerror(errno) << '\n';
+      closeSocket();
+      return false;
+    }
+    if (!ret) {
+      std::cerr << "Socket closed by remote peer.\n";
+      closeSocket();
+      return false;
+    }
+    in_buf.append(buf, ret);
+  }
+
+  // take every complete length-prefixed reply off the front of the buffer
+  std::size_t pos = 0;
+  while (in_buf.size() - pos >= sizeof(uint32_t)) {
+    uint32_t replyLength;
+    memcpy(&replyLength, in_buf.data() + pos, sizeof(replyLength));
+    replyLength = ntohl(replyLength);
+    if (replyLength > MAX_REPLY_LENGTH) {
+      std::cerr << "Got reply length " << replyLength << " which is greater than limit " << MAX_REPLY_LENGTH << ".\n";
+      closeSocket();
+      return false;
+    }
+    if (in_buf.size() - pos - sizeof(replyLength) < replyLength) {
+      break;
+    }
+
+    SSL_RefereeRemoteControlReply reply;
+    reply.ParseFromArray(in_buf.data() + pos + sizeof(replyLength), replyLength);
+    pos += sizeof(replyLength) + replyLength;
+    handleReply(reply);
+  }
+  in_buf.erase(0, pos);
+  return true;
+}
+
+void RemoteClient::handleReply(const SSL_RefereeRemoteControlReply &reply)
+{
+  auto it = in_flight.find(reply.message_id());
+  if (it == in_flight.end()) {
+    std::cerr << "Reply message ID " << reply.message_id() << " does not match any request in flight.\n";
+    return;
+  }
+
+  uint64_t now = GetTimeMicros();
+  double rtt = (now - it->second.send_time) / 1e6;
+  replies++;
+  rtt_sum += rtt;
+  rtt_max = std::max(rtt_max, rtt);
+
+  const RequestTag &tag = it->second.tag;
+  std::cout << "Command result is: " << SSL_RefereeRemoteControlReply::Outcome_Name(reply.outcome()) << " ("
+            << rtt * 1000 << " ms";
+  if (tag.event != nullptr) {
+    double send = it->second.send_time / 1e6;
+    std::cout << "; " << (now / 1e6 - tag.capture_time) * 1000 << " ms since capture, for " << tag.event;
+
+    DecisionLatency &d = decision_latency[tag.event];
+    d.capture_to_decision.recordSeconds(tag.decision_time - tag.capture_time);
+    d.decision_to_send.recordSeconds(send - tag.decision_time);
+    d.send_to_reply.recordSeconds(rtt);
+    d.capture_to_reply.recordSeconds(now / 1e6 - tag.capture_time);
+    if (reply.outcome() == SSL_RefereeRemoteControlReply::OK) {
+      d.accepted++;
+    }
+    else {
+      d.rejected++;
+    }
+  }
+  std::cout << ").\n";
+
+  if (reply_handler) {
+    reply_handler(it->second.request, reply, rtt);
+  }
+  in_flight.erase(it);
+}
+
+void RemoteClient::printDecisionLatency(FILE *f) const
+{
+  if (decision_latency.empty()) {
+    return;
+  }
+  fputs("\ndecision latency by event:\n", f);
+  PrintLatencyHeader(f);
+  for (const auto &e : decision_latency) {
+    const DecisionLatency &d = e.second;
+    fprintf(f, "%s (%lu accepted, %lu rejected)\n", e.first.c_str(), d.accepted, d.rejected);
+    PrintLatency(f, "  capture to decision", d.capture_to_decision);
+    PrintLatency(f, "  decision to send", d.decision_to_send);
+    PrintLatency(f, "  send to reply", d.send_to_reply);
+    PrintLatency(f, "  capture to reply", d.capture_to_reply);
+  }
+}
+
+bool RemoteClient::open(const char *hostname, int port, bool async_)
+{
+  async = async_;
+
   // Parse target address.
   struct addrinfo *refboxAddresses;
   {
@@ -159,6 +356,11 @@ bool RemoteClient::open(const char *hostname, int port)
       continue;
     }
     std::cout << "OK\n";
+
+    if (async) {
+      int flags = fcntl(sock, F_GETFL, 0);
+      fcntl(sock, F_SETFL, (flags < 0 ? 0 : flags) | O_NONBLOCK);
+    }
     return true;
   }
   return false;
@@ -5,8 +5,10 @@
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -20,10 +22,60 @@
 
 #include "rcon.pb.h"
 
+#include "latency.h"
+
 #define MAX_REPLY_LENGTH 4096
 
+// maximum number of requests sent without a reply yet in asynchronous mode
+#define MAX_IN_FLIGHT 8
+
+// what led to a request: the event that fired, the capture time of the frame
+// it fired on (or the deadline, for events that fire on one) and when the
+// autoref decided to send it, all in wall-clock seconds
+struct RequestTag
+{
+  const char *event;
+  double capture_time;
+  double decision_time;
+
+  RequestTag() : event(nullptr), capture_time(0), decision_time(0)
+  {
+  }
+  RequestTag(const char *event_, double capture_time_, double decision_time_)
+      : event(event_), capture_time(capture_time_), decision_time(decision_time_)
+  {
+  }
+};
+
+// the latencies of the tagged requests caused by one kind of event. Capture
+// times come from the vision computer's clock, so capture_to_decision is
+// only meaningful when that is synchronized with ours (values that come out
+// negative are counted as 0).
+struct DecisionLatency
+{
+  LatencyHistogram capture_to_decision;
+  // to the request being handed to the socket
+  LatencyHistogram decision_to_send;
+  LatencyHistogram send_to_reply;
+  LatencyHistogram capture_to_reply;
+
+  // replies with outcome OK, and any other outcome
+  uint64_t accepted, rejected;
+
+  DecisionLatency() : accepted(0), rejected(0)
+  {
+  }
+};
+
 class RemoteClient
 {
+public:
+  // called in asynchronous mode when the reply to a request arrives
+  typedef std::function<void(
+    const SSL_RefereeRemoteControlRequest &request, const SSL_RefereeRemoteControlReply &reply, double rtt)>
+    ReplyHandler;
+
+private:
   int sock;
 
   bool recvFully(void *buffer, std::size_t length);
@@ -33,12 +85,105 @@ class RemoteClient
 
   SSL_RefereeRemoteControlRequest createMessage();
 
+  // asynchronous mode state: requests not yet written, encoded bytes being
+  // written, requests awaiting a reply (by message_id), and reply bytes
+  // received so far
+  bool async;
+  struct InFlight
+  {
+    SSL_RefereeRemoteControlRequest request;
+    RequestTag tag;
+    // set when written (for those in the backlog, not yet)
+    uint64_t send_time;
+  };
+  std::deque<InFlight> backlog;
+  std::string out_buf;
+  std::size_t out_pos;
+  std::map<uint32_t, InFlight> in_flight;
+  std::string in_buf;
+
+  ReplyHandler reply_handler;
+
+  // round-trip statistics over all matched replies, in seconds
+  uint64_t replies;
+  double rtt_sum, rtt_max;
+
+  // time spent in sendRequest and onWritable
+  LatencyHistogram send_latency;
+
+  // for the replies to tagged requests, by event name
+  std::map<std::string, DecisionLatency> decision_latency;
+
+  void encodeBacklog();
+  void handleReply(const SSL_RefereeRemoteControlReply &reply);
+  void closeSocket();
+
 public:
-  RemoteClient() : sock(0){};
-  bool open(const char *hostname, int port);
+  RemoteClient()
+      : sock(-1), nextMessageID(0), async(false), out_pos(0), replies(0), rtt_sum(0), rtt_max(0){};
+  bool open(const char *hostname, int port, bool async_ = false);
+
+  bool isOpen() const
+  {
+    return sock >= 0;
+  }
+  int getFd() const
+  {
+    return sock;
+  }
 
+  // blocking mode: send a request and wait for its reply
   bool sendRequest(const SSL_RefereeRemoteControlRequest &request);
 
+  // asynchronous mode: assign the request a message ID and queue it; never
+  // blocks. The socket then has to be serviced by calling onWritable and
+  // onReadable when it is ready. The reply to a tagged request is counted in
+  // decisionLatency().
+  bool queueRequest(const SSL_RefereeRemoteControlRequest &request, const RequestTag &tag = RequestTag());
+  bool wantsWrite() const
+  {
+    return out_pos < out_buf.size() || (!backlog.empty() && in_flight.size() < MAX_IN_FLIGHT);
+  }
+  bool onWritable();
+  bool onReadable();
+
+  void setReplyHandler(ReplyHandler h)
+  {
+    reply_handler = h;
+  }
+
+  int inFlight() const
+  {
+    return in_flight.size();
+  }
+  int queued() const
+  {
+    return backlog.size();
+  }
+  uint64_t replyCount() const
+  {
+    return replies;
+  }
+  double meanRtt() const
+  {
+    return replies ? rtt_sum / replies : 0;
+  }
+  const LatencyHistogram &sendLatency() const
+  {
+    return send_latency;
+  }
+  const std::map<std::string, DecisionLatency> &decisionLatency() const
+  {
+    return decision_latency;
+  }
+  // a summary of decisionLatency(), one block per event (nothing if there
+  // were no replies to tagged requests)
+  void printDecisionLatency(FILE *f) const;
+  double maxRtt() const
+  {
+    return rtt_max;
+  }
+
   bool sendCard(SSL_RefereeRemoteControlRequest::CardInfo::CardType color,
                 SSL_RefereeRemoteControlRequest::CardInfo::CardTeam team);
   bool sendStage(SSL_Referee::Stage stage);
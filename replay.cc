@@ -0,0 +1,263 @@
+#include "replay.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "decoder.h"
+#include "flight_log.h"
+#include "util.h"
+
+// vision before the requested start is fed to the tracker (without running
+// the events) for this long, so that it has converged by then
+static const double ReplayWarmup = 1.0;
+
+static std::string eventName(const LogReader::Record &r)
+{
+  if (r.length < sizeof(LogEventMark)) {
+    return "";
+  }
+  return std::string(r.data + sizeof(LogEventMark), r.length - sizeof(LogEventMark));
+}
+
+// resolve a ReplayOptions::from spec to a log time
+static bool findStart(LogReader &reader, const std::string &from, double *t)
+{
+  if (reader.checkpoints().empty()) {
+    return false;
+  }
+
+  std::string spec = from;
+  int nth = 1;
+  size_t hash = spec.rfind('#');
+  if (hash != std::string::npos) {
+    nth = atoi(spec.c_str() + hash + 1);
+    spec.resize(hash);
+  }
+
+  size_t colon = spec.find(':');
+  if (colon == std::string::npos) {
+    char *end;
+    double offset = strtod(spec.c_str(), &end);
+    if (*end != 0) {
+      return false;
+    }
+    *t = reader.checkpoints()[0].time + offset;
+    return true;
+  }
+
+  std::string kind = spec.substr(0, colon), name = spec.substr(colon + 1);
+  SSL_Referee::Stage stage;
+  SSL_Referee::Command command;
+  for (const LogIndexEntry &e : reader.marks()) {
+    bool match = false;
+    if (kind == "stage" && e.kind == INDEX_STAGE && SSL_Referee::Stage_Parse(name, &stage)) {
+      match = (e.value == stage);
+    }
+    else if (kind == "command" && e.kind == INDEX_COMMAND && SSL_Referee::Command_Parse(name, &command)) {
+      match = (e.value == command);
+    }
+    else if (kind == "event" && e.kind == INDEX_EVENT) {
+      LogReader::Record r;
+      match = reader.seek(e.pos) && reader.next(r) && strcasestr(eventName(r).c_str(), name.c_str()) != nullptr;
+    }
+
+    if (match && --nth == 0) {
+      *t = e.time;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReplayLog(const char *path, BaseAutoref &autoref, ReplayStats &stats, const ReplayOptions &options)
+{
+  LogReader reader;
+  if (!reader.open(path)) {
+    return false;
+  }
+
+  autoref.useCaptureClock();
+
+  FrameDecoder decoder;
+  LogReader::Record rec;
+
+  // arrival times of the vision packets not yet in a processed world
+  std::vector<double> pending;
+  pending.reserve(64);
+
+  double first_capture = 0, last_capture = 0;
+  uint64_t start_wall = GetTimeMicros();
+
+  // records before start only warm up the tracker; records after stop are
+  // not read at all
+  double start = 0, stop = 0;
+  if (!options.from.empty()) {
+    if (!findStart(reader, options.from, &start)) {
+      fprintf(autoref.output(), "Nothing in the log matches \"%s\"\n", options.from.c_str());
+      return true;
+    }
+    start -= options.before;
+  }
+  else if (!reader.checkpoints().empty()) {
+    start = reader.checkpoints()[0].time;
+  }
+  if (options.duration > 0) {
+    stop = start + options.duration;
+  }
+
+  auto feed = [&](bool warmup) {
+    stats.packets++;
+    decoder.reset();
+
+    if (rec.type == LOG_EVENT) {
+      if (!warmup) {
+        fprintf(autoref.output(), "\n%.3f recorded event: %s\n", rec.time, eventName(rec).c_str());
+      }
+      return;
+    }
+
+    if (rec.type == LOG_REFEREE) {
+      const SSL_Referee *ref;
+      {
+        LatencyProbe probe(stats.parse_latency);
+        ref = decoder.parseReferee(rec.data, rec.length);
+      }
+      if (ref == nullptr) {
+        stats.parse_errors++;
+        return;
+      }
+      stats.referee_packets++;
+      autoref.updateReferee(*ref, RefereeHash(rec.data, rec.length));
+      return;
+    }
+
+    const SSL_WrapperPacket *vision;
+    {
+      LatencyProbe probe(stats.parse_latency);
+      vision = decoder.parseVision(rec.data, rec.length);
+    }
+    if (vision == nullptr) {
+      stats.parse_errors++;
+      return;
+    }
+    stats.vision_packets++;
+
+    if (vision->has_geometry() && autoref.updateGeometry(vision->geometry(), GeometryHash(rec.data, rec.length))) {
+      Constants::updateGeometry(vision->geometry());
+    }
+    if (!vision->has_detection()) {
+      return;
+    }
+    if (warmup) {
+      autoref.addVision(vision->detection());
+      return;
+    }
+
+    double t = vision->detection().t_capture();
+    if (first_capture == 0) {
+      first_capture = t;
+    }
+    last_capture = std::max(last_capture, t);
+
+    // deadlines that fall in the gap before this frame run first, as they
+    // would have live
+    double wake;
+    while ((wake = autoref.nextWakeTime()) > 0 && wake < t && autoref.tick(wake)) {
+      stats.ticks++;
+      stats.decisions += autoref.isRemoteReady();
+    }
+
+    autoref.addVision(vision->detection());
+    pending.push_back(rec.time);
+
+    uint64_t step_start = GetTimeMicros();
+    if (autoref.step()) {
+      // the packets held back while the tracker counts the cameras are not
+      // representative, so measuring starts after the first world
+      double processing = (GetTimeMicros() - step_start) / 1e6;
+      for (double arrival : pending) {
+        if (stats.frames == 0) {
+          break;
+        }
+        double latency = rec.time - arrival + processing;
+        stats.latency_sum += latency;
+        stats.latency_max = std::max(stats.latency_max, latency);
+        stats.latency_count++;
+      }
+      pending.clear();
+
+      stats.frames++;
+      stats.decisions += autoref.isRemoteReady();
+    }
+  };
+
+  // jump to the checkpoint before the warm-up and restore the referee state
+  // and geometry saved with it
+  if (!options.from.empty()) {
+    const LogIndexEntry *cp = reader.seekTime(start - ReplayWarmup);
+    if (cp != nullptr) {
+      uint64_t resume = cp->pos;
+      for (uint64_t p : {cp->geometry_pos, cp->referee_pos}) {
+        if (p != 0 && reader.seek(p) && reader.next(rec)) {
+          feed(true);
+        }
+      }
+      reader.seek(resume);
+    }
+  }
+
+  while (reader.next(rec)) {
+    if (stop > 0 && rec.time > stop) {
+      break;
+    }
+    feed(rec.time < start);
+  }
+
+  stats.wall_time = (GetTimeMicros() - start_wall) / 1e6;
+  stats.match_time = last_capture - first_capture;
+
+  if (reader.unsealedCount() > 0 || reader.badRecordCount() > 0) {
+    fprintf(autoref.output(),
+            "Log was not closed cleanly: %lu unsealed segments, %lu bad records\n",
+            reader.unsealedCount(),
+            reader.badRecordCount());
+  }
+  return true;
+}
+
+bool PrintLogIndex(const char *path, FILE *f)
+{
+  LogReader reader;
+  if (!reader.open(path)) {
+    return false;
+  }
+  if (reader.checkpoints().empty()) {
+    return true;
+  }
+
+  double t0 = reader.checkpoints()[0].time;
+  double t1 = reader.checkpoints().back().time;
+  fprintf(f, "%zu checkpoints covering %.1f s\n", reader.checkpoints().size(), t1 - t0);
+
+  for (const LogIndexEntry &e : reader.marks()) {
+    LogReader::Record r;
+    switch (e.kind) {
+      case INDEX_STAGE:
+        fprintf(f, "%9.3f  stage:%s\n", e.time - t0, SSL_Referee::Stage_Name(SSL_Referee::Stage(e.value)).c_str());
+        break;
+      case INDEX_COMMAND:
+        fprintf(f, "%9.3f  command:%s\n", e.time - t0, SSL_Referee::Command_Name(SSL_Referee::Command(e.value)).c_str());
+        break;
+      case INDEX_EVENT:
+        if (reader.seek(e.pos) && reader.next(r)) {
+          fprintf(f, "%9.3f  event:%s\n", e.time - t0, eventName(r).c_str());
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "base_ref.h"
+#include "latency.h"
+
+struct ReplayStats
+{
+  // records read from the log, by kind
+  uint64_t packets;
+  uint64_t vision_packets;
+  uint64_t referee_packets;
+  uint64_t parse_errors;
+
+  // worlds the events were run on, and runs triggered by deadlines alone
+  uint64_t frames;
+  uint64_t ticks;
+
+  // requests the autoref would have sent to the refbox
+  uint64_t decisions;
+
+  // for each vision packet, the time from its arrival until a world
+  // including it has been through the events: the arrival-time gap to the
+  // packet that completed that world, plus the processing time (s)
+  double latency_sum;
+  double latency_max;
+  uint64_t latency_count;
+
+  // span of capture time covered, and wall-clock time taken, in seconds
+  double match_time;
+  double wall_time;
+
+  // time taken to parse each vision and referee record
+  LatencyHistogram parse_latency;
+
+  ReplayStats()
+      : packets(0),
+        vision_packets(0),
+        referee_packets(0),
+        parse_errors(0),
+        frames(0),
+        ticks(0),
+        decisions(0),
+        latency_sum(0),
+        latency_max(0),
+        latency_count(0),
+        match_time(0),
+        wall_time(0)
+  {
+  }
+};
+
+struct ReplayOptions
+{
+  // where to start: empty for the beginning, a number of seconds from the
+  // beginning, or stage:NAME, command:NAME (SSL_Referee enum names) or
+  // event:TEXT (part of an autoref event name), optionally followed by #n for
+  // the nth occurrence
+  std::string from;
+
+  // start this many seconds before that
+  double before;
+
+  // stop after this many seconds (0: run to the end)
+  double duration;
+
+  ReplayOptions() : before(0), duration(0)
+  {
+  }
+};
+
+// Feed a flight recorder log (a segment file or a recording prefix) through
+// the autoref as fast as possible, with no sockets and no pacing. Time is
+// taken from the capture timestamps of the vision frames; deadline-driven
+// events run when the capture time passes their deadline. With a start
+// point, replay jumps through the log index to the checkpoint before it and
+// warms up the tracker from there. Returns false if the log could not be
+// opened.
+bool ReplayLog(const char *path,
+               BaseAutoref &autoref,
+               ReplayStats &stats,
+               const ReplayOptions &options = ReplayOptions());
+
+// print the stage, command and event entries of a log's index
+bool PrintLogIndex(const char *path, FILE *f);
@@ -1,31 +1,33 @@
 #include "constants.h"
 
-double Constants::TimeInHalf;
+#include "field_model.h"
 
-double Constants::TimeInHalftime;
-double Constants::KickDeadline;
+thread_local double Constants::TimeInHalf;
 
-double Constants::FrameRate;
-double Constants::FramePeriod;
-unsigned int Constants::FrameRateInt;
+thread_local double Constants::TimeInHalftime;
+thread_local double Constants::KickDeadline;
+
+thread_local double Constants::FrameRate;
+thread_local double Constants::FramePeriod;
+thread_local unsigned int Constants::FrameRateInt;
 
 // distance-related values (common)
-float Constants::MaxRobotRadius;
-float Constants::BallRadius;
-int Constants::DribblerOffset;
+thread_local float Constants::MaxRobotRadius;
+thread_local float Constants::BallRadius;
+thread_local int Constants::DribblerOffset;
 
 // misc
-float Constants::MaxKickSpeed;
-int Constants::MaxTeamRobots;
-int Constants::MaxRobots;
+thread_local float Constants::MaxKickSpeed;
+thread_local int Constants::MaxTeamRobots;
+thread_local int Constants::MaxRobots;
 
 // field geometry (by division)
-float Constants::FieldLengthH;
-float Constants::FieldWidthH;
-float Constants::DefenseLength;
-float Constants::DefenseWidthH;
-float Constants::GoalDepth;
-float Constants::GoalWidthH;
+thread_local float Constants::FieldLengthH;
+thread_local float Constants::FieldWidthH;
+thread_local float Constants::DefenseLength;
+thread_local float Constants::DefenseWidthH;
+thread_local float Constants::GoalDepth;
+thread_local float Constants::GoalWidthH;
 
 void Constants::initCommon()
 {
@@ -50,6 +52,7 @@ void Constants::initDivisionA()
   MaxRobots = MaxTeamRobots * NumTeams;
   DefenseLength = 1200;
   DefenseWidthH = 1200;
+  FieldModel::update();
 }
 
 void Constants::initDivisionB()
@@ -59,6 +62,7 @@ void Constants::initDivisionB()
   MaxRobots = MaxTeamRobots * NumTeams;
   DefenseLength = 1000;
   DefenseWidthH = 1000;
+  FieldModel::update();
 }
 
 void Constants::updateGeometry(const SSL_GeometryData &g)
@@ -69,4 +73,52 @@ void Constants::updateGeometry(const SSL_GeometryData &g)
   FieldWidthH = f.field_width() / 2.;
   GoalDepth = f.goal_depth();
   GoalWidthH = f.goal_width() / 2.;
+  FieldModel::update();
+}
+
+Constants::Values Constants::get()
+{
+  Values v;
+  v.TimeInHalf = TimeInHalf;
+  v.TimeInHalftime = TimeInHalftime;
+  v.KickDeadline = KickDeadline;
+  v.FrameRate = FrameRate;
+  v.FramePeriod = FramePeriod;
+  v.FrameRateInt = FrameRateInt;
+  v.MaxRobotRadius = MaxRobotRadius;
+  v.BallRadius = BallRadius;
+  v.DribblerOffset = DribblerOffset;
+  v.MaxKickSpeed = MaxKickSpeed;
+  v.MaxTeamRobots = MaxTeamRobots;
+  v.MaxRobots = MaxRobots;
+  v.FieldLengthH = FieldLengthH;
+  v.FieldWidthH = FieldWidthH;
+  v.DefenseLength = DefenseLength;
+  v.DefenseWidthH = DefenseWidthH;
+  v.GoalDepth = GoalDepth;
+  v.GoalWidthH = GoalWidthH;
+  return v;
+}
+
+void Constants::set(const Values &v)
+{
+  TimeInHalf = v.TimeInHalf;
+  TimeInHalftime = v.TimeInHalftime;
+  KickDeadline = v.KickDeadline;
+  FrameRate = v.FrameRate;
+  FramePeriod = v.FramePeriod;
+  FrameRateInt = v.FrameRateInt;
+  MaxRobotRadius = v.MaxRobotRadius;
+  BallRadius = v.BallRadius;
+  DribblerOffset = v.DribblerOffset;
+  MaxKickSpeed = v.MaxKickSpeed;
+  MaxTeamRobots = v.MaxTeamRobots;
+  MaxRobots = v.MaxRobots;
+  FieldLengthH = v.FieldLengthH;
+  FieldWidthH = v.FieldWidthH;
+  DefenseLength = v.DefenseLength;
+  DefenseWidthH = v.DefenseWidthH;
+  GoalDepth = v.GoalDepth;
+  GoalWidthH = v.GoalWidthH;
+  FieldModel::update();
 }
@@ -5,41 +5,61 @@
 
 #include "messages_robocup_ssl_geometry.pb.h"
 
+// Values are per thread, so that autoref instances running side by side on
+// different threads (e.g., batch evaluation) can each be set up for their own
+// division and field; every thread that runs an autoref must call one of the
+// init functions first.
 class Constants
 {
 public:
   // time-related values
-  static double TimeInHalf;
-  static double TimeInHalftime;
-  static double KickDeadline;
+  static thread_local double TimeInHalf;
+  static thread_local double TimeInHalftime;
+  static thread_local double KickDeadline;
 
-  static double FrameRate;
-  static double FramePeriod;
-  static unsigned int FrameRateInt;
+  static thread_local double FrameRate;
+  static thread_local double FramePeriod;
+  static thread_local unsigned int FrameRateInt;
 
   // distance-related values (common)
-  static float MaxRobotRadius;
-  static float BallRadius;
-  static int DribblerOffset;
+  static thread_local float MaxRobotRadius;
+  static thread_local float BallRadius;
+  static thread_local int DribblerOffset;
 
   // misc
-  static float MaxKickSpeed;
-  static int MaxTeamRobots;
-  static int MaxRobots;
+  static thread_local float MaxKickSpeed;
+  static thread_local int MaxTeamRobots;
+  static thread_local int MaxRobots;
 
   // field geometry (by division)
-  static float FieldLengthH;
-  static float FieldWidthH;
-  static float DefenseLength;
-  static float DefenseWidthH;
-  static float GoalDepth;
-  static float GoalWidthH;
+  static thread_local float FieldLengthH;
+  static thread_local float FieldWidthH;
+  static thread_local float DefenseLength;
+  static thread_local float DefenseWidthH;
+  static thread_local float GoalDepth;
+  static thread_local float GoalWidthH;
 
   // init functions
   static void initCommon();
   static void initDivisionA();
   static void initDivisionB();
   static void updateGeometry(const SSL_GeometryData &g);
+
+  // all of the values above, for setting up another thread the same way as
+  // this one
+  struct Values
+  {
+    double TimeInHalf, TimeInHalftime, KickDeadline;
+    double FrameRate, FramePeriod;
+    unsigned int FrameRateInt;
+    float MaxRobotRadius, BallRadius;
+    int DribblerOffset;
+    float MaxKickSpeed;
+    int MaxTeamRobots, MaxRobots;
+    float FieldLengthH, FieldWidthH, DefenseLength, DefenseWidthH, GoalDepth, GoalWidthH;
+  };
+  static Values get();
+  static void set(const Values &v);
 };
 
 enum Team : int
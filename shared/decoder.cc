@@ -0,0 +1,134 @@
+#include "decoder.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "util.h"
+
+using google::protobuf::Arena;
+using google::protobuf::ArenaOptions;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// hash of the encoded top-level fields of a message. If only_field is
+// nonzero, only the payloads of that (length-delimited) field are hashed;
+// otherwise every field not flagged in skip_mask (bit n = field number n) is
+// hashed, tag included.
+static uint64_t hashFields(const void *data, int len, int only_field, uint64_t skip_mask)
+{
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  CodedInputStream in(bytes, len);
+
+  uint64_t h = HashSeed;
+  bool any = false;
+  while (true) {
+    int start = in.CurrentPosition();
+    uint32_t tag = in.ReadTag();
+    if (tag == 0) {
+      break;
+    }
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+
+    if (only_field != 0) {
+      if (field == only_field && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+        uint32_t size;
+        if (!in.ReadVarint32(&size)) {
+          return 0;
+        }
+        int payload = in.CurrentPosition();
+        if (!in.Skip(size)) {
+          return 0;
+        }
+        h = HashBytes(bytes + payload, size, h);
+        any = true;
+        continue;
+      }
+      if (!WireFormatLite::SkipField(&in, tag)) {
+        return 0;
+      }
+      continue;
+    }
+
+    if (!WireFormatLite::SkipField(&in, tag)) {
+      return 0;
+    }
+    if (field < 64 && (skip_mask & (1ULL << field))) {
+      continue;
+    }
+    h = HashBytes(bytes + start, in.CurrentPosition() - start, h);
+    any = true;
+  }
+
+  // never return 0 for real content
+  return any ? (h | 1) : 0;
+}
+
+uint64_t GeometryHash(const void *data, int len)
+{
+  return hashFields(data, len, SSL_WrapperPacket::kGeometryFieldNumber, 0);
+}
+
+uint64_t RefereeHash(const void *data, int len)
+{
+  return hashFields(data,
+                    len,
+                    0,
+                    (1ULL << SSL_Referee::kPacketTimestampFieldNumber) | (1ULL << SSL_Referee::kStageTimeLeftFieldNumber));
+}
+
+bool RefereeStageCommand(const void *data, int len, int *stage, int *command)
+{
+  CodedInputStream in(static_cast<const uint8_t *>(data), len);
+  bool have_stage = false, have_command = false;
+  while (true) {
+    uint32_t tag = in.ReadTag();
+    if (tag == 0) {
+      break;
+    }
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    if ((field == SSL_Referee::kStageFieldNumber || field == SSL_Referee::kCommandFieldNumber)
+        && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_VARINT) {
+      uint32_t v;
+      if (!in.ReadVarint32(&v)) {
+        return false;
+      }
+      if (field == SSL_Referee::kStageFieldNumber) {
+        *stage = v;
+        have_stage = true;
+      }
+      else {
+        *command = v;
+        have_command = true;
+      }
+      continue;
+    }
+    if (!WireFormatLite::SkipField(&in, tag)) {
+      return false;
+    }
+  }
+  return have_stage && have_command;
+}
+
+ArenaOptions FrameDecoder::makeOptions(std::vector<char> &block)
+{
+  ArenaOptions options;
+  options.initial_block = block.data();
+  options.initial_block_size = block.size();
+  return options;
+}
+
+FrameDecoder::FrameDecoder(size_t block_size) : block(block_size), arena(makeOptions(block))
+{
+}
+
+const SSL_WrapperPacket *FrameDecoder::parseVision(const void *data, int len)
+{
+  auto *msg = Arena::CreateMessage<SSL_WrapperPacket>(&arena);
+  return msg->ParseFromArray(data, len) ? msg : nullptr;
+}
+
+const SSL_Referee *FrameDecoder::parseReferee(const void *data, int len)
+{
+  auto *msg = Arena::CreateMessage<SSL_Referee>(&arena);
+  return msg->ParseFromArray(data, len) ? msg : nullptr;
+}
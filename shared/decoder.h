@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+
+#include "messages_robocup_ssl_wrapper.pb.h"
+#include "ssl_referee.pb.h"
+
+// Decodes packets into a protobuf Arena whose first block is owned by the
+// decoder and reused, so that in steady state decoding a frame does not touch
+// the heap at all. Parsed messages are handed out as const views that stay
+// valid until reset(), which releases everything at once.
+class FrameDecoder
+{
+public:
+  static const size_t DefaultBlockSize = 32 * 1024;
+
+private:
+  std::vector<char> block;
+  google::protobuf::Arena arena;
+
+  static google::protobuf::ArenaOptions makeOptions(std::vector<char> &block);
+
+public:
+  explicit FrameDecoder(size_t block_size = DefaultBlockSize);
+
+  FrameDecoder(const FrameDecoder &) = delete;
+  FrameDecoder &operator=(const FrameDecoder &) = delete;
+
+  // parse a packet; returns nullptr if it does not parse
+  const SSL_WrapperPacket *parseVision(const void *data, int len);
+  const SSL_Referee *parseReferee(const void *data, int len);
+
+  // end of frame: drop every message parsed since the last reset
+  void reset()
+  {
+    arena.Reset();
+  }
+
+  uint64_t spaceUsed() const
+  {
+    return arena.SpaceUsed();
+  }
+};
+
+// Content hashes computed directly on the encoded bytes, used to skip
+// reprocessing packets whose content has not changed. 0 means "no content".
+
+// hash of the geometry carried by an encoded SSL_WrapperPacket
+uint64_t GeometryHash(const void *data, int len);
+
+// hash of an encoded SSL_Referee, ignoring the fields that change in every
+// packet (packet_timestamp and stage_time_left)
+uint64_t RefereeHash(const void *data, int len);
+
+// read just the stage and command of an encoded SSL_Referee, without parsing
+// the rest; returns false if either is missing
+bool RefereeStageCommand(const void *data, int len, int *stage, int *command);
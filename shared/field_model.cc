@@ -0,0 +1,121 @@
+#include "field_model.h"
+
+#include <cmath>
+
+#include "constants.h"
+#include "util.h"
+
+static thread_local FieldModel current;
+
+const FieldModel &FieldModel::get()
+{
+  return current;
+}
+
+bool FieldModel::update()
+{
+  float in[] = {Constants::FieldLengthH,
+                Constants::FieldWidthH,
+                Constants::DefenseLength,
+                Constants::DefenseWidthH,
+                Constants::GoalDepth,
+                Constants::GoalWidthH};
+  int max_team_robots = Constants::MaxTeamRobots;
+  uint64_t h = HashBytes(in, sizeof(in));
+  h = HashBytes(&max_team_robots, sizeof(max_team_robots), h) | 1;
+  if (h == current.hash) {
+    return false;
+  }
+
+  FieldModel &m = current;
+  m.length_h = in[0];
+  m.width_h = in[1];
+  m.defense_length = in[2];
+  m.defense_width_h = in[3];
+  m.goal_depth = in[4];
+  m.goal_width_h = in[5];
+  m.max_team_robots = max_team_robots;
+  m.hash = h;
+
+  m.defense_front = m.length_h - m.defense_length;
+  m.defense_diagonal = m.defense_front + m.defense_width_h;
+  m.goals[0] = {-m.length_h - m.goal_depth, -m.length_h, -m.goal_width_h, m.goal_width_h};
+  m.goals[1] = {m.length_h, m.length_h + m.goal_depth, -m.goal_width_h, m.goal_width_h};
+  return true;
+}
+
+double FieldModel::defenseDist(vector2f loc, bool positive_x) const
+{
+  float x = positive_x ? loc.x : -loc.x, y = std::abs(loc.y);
+
+  if (y < defense_width_h) {
+    return std::abs(x - defense_front);
+  }
+  if (x > defense_front) {
+    return y - defense_width_h;
+  }
+  return std::hypot(x - defense_front, y - defense_width_h);
+}
+
+vector2f FieldModel::closestDefenseAreaP(vector2f loc, bool positive_x, double dist) const
+{
+  auto sgn = positive_x ? 1 : -1;
+  auto x = sgn * loc.x, y = std::abs(loc.y);
+
+  vector2f ret = loc;
+
+  if (x > defense_front && x + y > defense_diagonal) {
+    ret.set(x, defense_width_h + dist);
+  }
+  else if (y < defense_width_h && x + y <= defense_diagonal) {
+    ret.set(defense_front - dist, y);
+  }
+  else {
+    vector2f corner(defense_front, defense_width_h);
+    ret.set(corner + (loc - corner).norm(dist));
+  }
+
+  if (loc.y < 0) {
+    ret.y *= -1;
+  }
+  return ret * sgn;
+}
+
+bool FieldModel::inField(vector2f loc, float margin, bool avoid_defense) const
+{
+  auto x = std::abs(loc.x), y = std::abs(loc.y);
+
+  // check outside field boundaries
+  if (x > length_h - margin || y > width_h - margin) {
+    return false;
+  }
+
+  // check defense area
+  return !(avoid_defense && x > defense_front - margin && y < defense_width_h + margin);
+}
+
+vector2f FieldModel::outOfBoundsLoc(vector2f loc, vector2f dir) const
+{
+  int signx = sign(dir.x);
+  int signy = sign(dir.y);
+  if (dir.x == 0 && dir.y == 0) {
+    return loc;
+  }
+  if (dir.x == 0) {
+    return vector2f(loc.x, signy * width_h);
+  }
+  if (dir.y == 0) {
+    return vector2f(signx * length_h, loc.y);
+  }
+
+  // time to reach the goal line and the touch line it is heading for
+  vector2f d = dir.norm();
+  double xtime = (signx * length_h - loc.x) / d.x;
+  double ytime = (signy * width_h - loc.y) / d.y;
+  if (signx == -1 || signy == -1) {
+    xtime = fabs(xtime);
+    ytime = fabs(ytime);
+  }
+  return (xtime < ytime) ? vector2f(signx * length_h, loc.y + xtime * d.y)
+                         : vector2f(loc.x + ytime * d.x, signy * width_h);
+}
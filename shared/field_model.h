@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gvector.h"
+
+// The shapes of the field, derived from the Constants once instead of on
+// every query. Like the Constants, each thread has its own; Constants
+// rebuilds it whenever its field or division values are set, which does
+// nothing unless the values the model is made from changed (as told by
+// their hash). Anything that keeps values derived from the model can tell
+// whether they are stale by comparing the hash it built them from.
+//
+// The field boundary is the rectangle |x| < length_h, |y| < width_h, and
+// each defense area is the part of it with |x| > defense_front and
+// |y| < defense_width_h on one side.
+class FieldModel
+{
+public:
+  // an axis-aligned box, not including its edges
+  struct Box
+  {
+    float x_min, x_max, y_min, y_max;
+
+    bool contains(vector2f p) const
+    {
+      return p.x > x_min && p.x < x_max && p.y > y_min && p.y < y_max;
+    }
+  };
+
+  // what the model is made from
+  float length_h, width_h, defense_length, defense_width_h, goal_depth, goal_width_h;
+  int max_team_robots;
+
+  // hash of the values above; never 0
+  uint64_t hash;
+
+  // |x| of the defense areas' front lines
+  float defense_front;
+  // x + |y| along the diagonals through the front corners of the defense
+  // areas, which split the points nearest to the fronts from those nearest
+  // to the sides
+  float defense_diagonal;
+
+  // the inside of each goal, behind the goal line, indexed by positive_x
+  Box goals[2];
+
+  // distance from loc to the boundary of the defense area on the given side
+  // (from inside too, where it is the distance to the front line)
+  double defenseDist(vector2f loc, bool positive_x) const;
+
+  // the point dist away from the defense area on the given side, in the
+  // direction of loc
+  vector2f closestDefenseAreaP(vector2f loc, bool positive_x, double dist) const;
+
+  // whether loc is at least margin inside the boundary (and outside the
+  // defense areas grown by margin, if avoid_defense)
+  bool inField(vector2f loc, float margin, bool avoid_defense) const;
+
+  bool inGoal(vector2f loc) const
+  {
+    return goals[loc.x > 0].contains(loc);
+  }
+
+  // where the ray from loc along dir leaves the field
+  vector2f outOfBoundsLoc(vector2f loc, vector2f dir) const;
+
+  // this thread's model
+  static const FieldModel &get();
+
+  // rebuilds this thread's model from its Constants if they changed;
+  // returns whether they did
+  static bool update();
+};
@@ -0,0 +1,657 @@
+#include "flight_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "util.h"
+
+static uint64_t padded(uint64_t n)
+{
+  return (n + 7) & ~static_cast<uint64_t>(7);
+}
+
+//====================================================================//
+//  LogIndexer
+//====================================================================//
+
+constexpr double LogIndexer::CheckpointInterval;
+
+LogIndexer::LogIndexer()
+{
+  reset();
+}
+
+void LogIndexer::reset()
+{
+  next_checkpoint = 0;
+  referee_pos = geometry_pos = 0;
+  stage = command = -1;
+  entries.clear();
+}
+
+void LogIndexer::push(LogIndexKind kind, int value, double time, uint64_t pos)
+{
+  LogIndexEntry e;
+  memset(&e, 0, sizeof(e));
+  e.kind = kind;
+  e.value = value;
+  e.time = time;
+  e.pos = pos;
+  if (kind == INDEX_CHECKPOINT) {
+    e.referee_pos = referee_pos;
+    e.geometry_pos = geometry_pos;
+  }
+  entries.push_back(e);
+}
+
+void LogIndexer::add(LogRecordType type, double time, uint64_t pos, const void *data, uint32_t length)
+{
+  if (time >= next_checkpoint) {
+    push(INDEX_CHECKPOINT, 0, time, pos);
+    next_checkpoint = time + CheckpointInterval;
+  }
+
+  switch (type) {
+    case LOG_REFEREE: {
+      int s, c;
+      if (RefereeStageCommand(data, length, &s, &c)) {
+        if (s != stage) {
+          push(INDEX_STAGE, s, time, pos);
+        }
+        if (c != command) {
+          push(INDEX_COMMAND, c, time, pos);
+        }
+        stage = s;
+        command = c;
+      }
+      referee_pos = pos;
+      break;
+    }
+    case LOG_GEOMETRY:
+      geometry_pos = pos;
+      break;
+    case LOG_EVENT:
+      push(INDEX_EVENT, 0, time, pos);
+      break;
+    default:
+      break;
+  }
+}
+
+void LogIndexer::resume(const LogIndexEntry *index, size_t n)
+{
+  entries.clear();
+  for (size_t i = 0; i < n; i++) {
+    const LogIndexEntry &e = index[i];
+    switch (e.kind) {
+      case INDEX_CHECKPOINT:
+        next_checkpoint = e.time + CheckpointInterval;
+        referee_pos = e.referee_pos;
+        geometry_pos = e.geometry_pos;
+        break;
+      case INDEX_STAGE:
+        stage = e.value;
+        break;
+      case INDEX_COMMAND:
+        command = e.value;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+//====================================================================//
+//  FlightRecorder
+//====================================================================//
+
+FlightRecorder::FlightRecorder()
+    : segment_size(0),
+      max_segments(0),
+      retired_bytes(0),
+      next_sequence(0),
+      work_pending(false),
+      stopping(false),
+      pos(0),
+      segment_records(0),
+      first_time(0),
+      last_time(0),
+      total_records(0),
+      dropped(0),
+      rotations(0)
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  close();
+}
+
+std::string FlightRecorder::segmentName(const std::string &prefix, uint64_t sequence)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), ".%06lu.arlog", sequence);
+  return prefix + buf;
+}
+
+std::vector<uint64_t> FlightRecorder::segmentSequences(const std::string &prefix)
+{
+  size_t slash = prefix.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : prefix.substr(0, slash + 1);
+  std::string base = prefix.substr(slash == std::string::npos ? 0 : slash + 1);
+
+  std::vector<uint64_t> sequences;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return sequences;
+  }
+  while (const dirent *e = readdir(d)) {
+    const char *name = e->d_name;
+    unsigned long sequence;
+    int n = 0;
+    if (strncmp(name, base.c_str(), base.size()) == 0
+        && sscanf(name + base.size(), ".%lu.arlog%n", &sequence, &n) == 1 && n > 0 && name[base.size() + n] == 0) {
+      sequences.push_back(sequence);
+    }
+  }
+  closedir(d);
+  std::sort(sequences.begin(), sequences.end());
+  return sequences;
+}
+
+bool FlightRecorder::createSegment(Segment &seg, uint64_t sequence, bool report)
+{
+  // never take over an existing file, which may be a segment another
+  // recorder is still writing
+  std::string name = segmentName(prefix, sequence);
+  int fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    if (report) {
+      fprintf(stderr, "ERROR CREATING LOG SEGMENT %s: %s\n", name.c_str(), strerror(errno));
+    }
+    return false;
+  }
+
+  // reserve the disk space now so that appends cannot fail with SIGBUS
+  int err = posix_fallocate(fd, 0, segment_size);
+  if (err != 0) {
+    if (report) {
+      fprintf(stderr, "ERROR ALLOCATING LOG SEGMENT %s: %s\n", name.c_str(), strerror(err));
+    }
+    ::close(fd);
+    unlink(name.c_str());
+    return false;
+  }
+
+  void *p = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (p == MAP_FAILED) {
+    if (report) {
+      fprintf(stderr, "ERROR MAPPING LOG SEGMENT %s: %s\n", name.c_str(), strerror(errno));
+    }
+    ::close(fd);
+    unlink(name.c_str());
+    return false;
+  }
+
+  seg.fd = fd;
+  seg.base = static_cast<char *>(p);
+  seg.sequence = sequence;
+
+  auto *hdr = reinterpret_cast<LogSegmentHeader *>(seg.base);
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->magic = LogMagic;
+  hdr->version = LogVersion;
+  hdr->segment_size = segment_size;
+  hdr->sequence = sequence;
+  hdr->committed = sizeof(LogSegmentHeader);
+  return true;
+}
+
+void FlightRecorder::releaseSegment(Segment &seg, uint64_t keep_bytes)
+{
+  if (seg.base == nullptr) {
+    return;
+  }
+  munmap(seg.base, segment_size);
+  if (keep_bytes > 0) {
+    // give back the unused preallocated space
+    if (ftruncate(seg.fd, keep_bytes) != 0) {
+      fprintf(stderr, "ERROR TRUNCATING LOG SEGMENT: %s\n", strerror(errno));
+    }
+  }
+  else {
+    unlink(segmentName(prefix, seg.sequence).c_str());
+  }
+  ::close(seg.fd);
+  seg = Segment();
+}
+
+bool FlightRecorder::open(const char *prefix_, uint64_t segment_size_, int max_segments_)
+{
+  close();
+
+  prefix = prefix_;
+  segment_size = padded(segment_size_);
+  max_segments = max_segments_;
+  total_records = dropped = rotations = 0;
+  indexer.reset();
+  // enough room that appending index entries never allocates in practice
+  indexer.entries.reserve(16384);
+
+  std::vector<uint64_t> existing = segmentSequences(prefix);
+  uint64_t first = existing.empty() ? 0 : existing.back() + 1;
+  if (!createSegment(current, first, true)) {
+    return false;
+  }
+
+  pos = sizeof(LogSegmentHeader);
+  segment_records = 0;
+  first_time = last_time = 0;
+
+  // the helper makes the first spare right away
+  retired_bytes = 0;
+  next_sequence = first + 1;
+  work_pending = true;
+  stopping = false;
+  helper = std::thread(&FlightRecorder::help, this);
+  return true;
+}
+
+void FlightRecorder::help()
+{
+  // whether the last spare could not be created; a failure that repeats on
+  // every retry is only reported the first time
+  bool failed = false;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake.wait(lock, [this] { return work_pending || stopping; });
+    if (!work_pending) {
+      return;
+    }
+    Segment old = retired;
+    uint64_t keep_bytes = retired_bytes;
+    uint64_t sequence = next_sequence;
+    retired = Segment();
+    lock.unlock();
+
+    releaseSegment(old, keep_bytes);
+    // with the spare, this leaves max_segments segments before it
+    if (max_segments > 0 && sequence > static_cast<uint64_t>(max_segments)) {
+      unlink(segmentName(prefix, sequence - 1 - max_segments).c_str());
+    }
+    Segment seg;
+    failed = !createSegment(seg, sequence, !failed);
+
+    lock.lock();
+    spare = seg;
+    work_pending = false;
+  }
+}
+
+uint64_t FlightRecorder::footerSpace(size_t extra) const
+{
+  return padded(sizeof(LogRecordHeader) + sizeof(LogFooter) + (indexer.entries.size() + extra) * sizeof(LogIndexEntry));
+}
+
+void FlightRecorder::seal()
+{
+  LogFooter footer;
+  footer.records = segment_records;
+  footer.first_time = first_time;
+  footer.last_time = last_time;
+  footer.index_entries = indexer.entries.size();
+
+  // room for the footer is always kept free by append
+  uint64_t footer_offset = pos;
+  auto *rh = reinterpret_cast<LogRecordHeader *>(current.base + pos);
+  char *payload = reinterpret_cast<char *>(rh + 1);
+  size_t index_bytes = footer.index_entries * sizeof(LogIndexEntry);
+  memcpy(payload, &footer, sizeof(footer));
+  memcpy(payload + sizeof(footer), indexer.entries.data(), index_bytes);
+
+  rh->type = LOG_FOOTER;
+  rh->port = 0;
+  rh->length = sizeof(footer) + index_bytes;
+  rh->time = last_time;
+  rh->checksum = HashBytes(payload, rh->length);
+  pos += padded(sizeof(LogRecordHeader) + rh->length);
+
+  auto *hdr = reinterpret_cast<LogSegmentHeader *>(current.base);
+  hdr->footer_offset = footer_offset;
+  __atomic_store_n(&hdr->committed, pos, __ATOMIC_RELEASE);
+  __atomic_store_n(&hdr->sealed, 1, __ATOMIC_RELEASE);
+  indexer.entries.clear();
+}
+
+bool FlightRecorder::rotate()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare.base == nullptr) {
+      // unless the helper is still making it, creating the spare failed;
+      // have it try again, so that recording resumes once it can
+      if (!work_pending) {
+        work_pending = true;
+        wake.notify_one();
+      }
+      return false;
+    }
+    seal();
+    // the helper has already taken the previous retired segment, since it
+    // made the spare after that
+    retired = current;
+    retired_bytes = pos;
+    next_sequence = spare.sequence + 1;
+    work_pending = true;
+    current = spare;
+    spare = Segment();
+  }
+  wake.notify_one();
+  rotations++;
+
+  pos = sizeof(LogSegmentHeader);
+  segment_records = 0;
+  first_time = last_time = 0;
+  return true;
+}
+
+bool FlightRecorder::append(LogRecordType type, uint16_t port, double time, const void *data, uint32_t length)
+{
+  if (current.base == nullptr) {
+    return false;
+  }
+
+  // a record adds at most three index entries (checkpoint, stage, command)
+  static const int MaxNewEntries = 3;
+  uint64_t need = padded(sizeof(LogRecordHeader) + length);
+
+  if (sizeof(LogSegmentHeader) + need + padded(sizeof(LogRecordHeader) + sizeof(LogFooter)
+                                                + MaxNewEntries * sizeof(LogIndexEntry))
+      > segment_size) {
+    dropped++;
+    return false;
+  }
+  if (pos + need + footerSpace(MaxNewEntries) > segment_size) {
+    if (!rotate()) {
+      dropped++;
+      return false;
+    }
+  }
+
+  indexer.add(type, time, LogPos(current.sequence, pos), data, length);
+
+  auto *rh = reinterpret_cast<LogRecordHeader *>(current.base + pos);
+  rh->type = type;
+  rh->port = port;
+  rh->length = length;
+  rh->time = time;
+  rh->checksum = HashBytes(data, length);
+  memcpy(rh + 1, data, length);
+  pos += need;
+
+  auto *hdr = reinterpret_cast<LogSegmentHeader *>(current.base);
+  __atomic_store_n(&hdr->committed, pos, __ATOMIC_RELEASE);
+
+  if (segment_records++ == 0) {
+    first_time = time;
+  }
+  last_time = time;
+  total_records++;
+  return true;
+}
+
+void FlightRecorder::close()
+{
+  if (helper.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    helper.join();
+  }
+  if (current.base != nullptr) {
+    seal();
+    releaseSegment(current, pos);
+  }
+  releaseSegment(spare, 0);
+}
+
+//====================================================================//
+//  LogReader
+//====================================================================//
+
+LogReader::LogReader()
+    : first_sequence(0),
+      file_index(0),
+      base(nullptr),
+      size(0),
+      end(0),
+      pos(0),
+      record_pos(0),
+      unsealed(0),
+      bad_records(0)
+{
+}
+
+LogReader::~LogReader()
+{
+  close();
+}
+
+bool LogReader::open(const char *path)
+{
+  close();
+  files.clear();
+  file_index = 0;
+  unsealed = bad_records = 0;
+  checkpoint_list.clear();
+  mark_list.clear();
+
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+    files.push_back(path);
+  }
+  else {
+    // a prefix: take consecutive segments, starting from the oldest one
+    // still present (older ones may have been rotated away)
+    std::vector<uint64_t> sequences = FlightRecorder::segmentSequences(path);
+    for (size_t i = 0; i < sequences.size() && sequences[i] == sequences[0] + i; i++) {
+      files.push_back(FlightRecorder::segmentName(path, sequences[i]));
+    }
+  }
+
+  if (files.empty() || !openSegment(0)) {
+    return false;
+  }
+  first_sequence = reinterpret_cast<const LogSegmentHeader *>(base)->sequence;
+
+  if (!loadIndex()) {
+    return false;
+  }
+  return openSegment(0);
+}
+
+bool LogReader::openSegment(size_t index)
+{
+  closeSegment();
+  file_index = index;
+  const std::string &path = files[index];
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR OPENING LOG SEGMENT %s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  size = st.st_size;
+  if (size < sizeof(LogSegmentHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "ERROR MAPPING LOG SEGMENT %s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  base = static_cast<const char *>(p);
+
+  const auto *hdr = reinterpret_cast<const LogSegmentHeader *>(base);
+  if (hdr->magic != LogMagic || hdr->version != LogVersion) {
+    fprintf(stderr, "%s is not a flight recorder log (or an old version)\n", path.c_str());
+    closeSegment();
+    return false;
+  }
+
+  end = std::min<uint64_t>(hdr->committed, size);
+  pos = sizeof(LogSegmentHeader);
+  return true;
+}
+
+bool LogReader::loadIndex()
+{
+  // sealed segments carry their index in the footer; others are scanned
+  LogIndexer indexer;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!openSegment(i)) {
+      return false;
+    }
+    const auto *hdr = reinterpret_cast<const LogSegmentHeader *>(base);
+
+    const LogIndexEntry *index = nullptr;
+    size_t n = 0;
+    if (hdr->sealed && hdr->footer_offset + sizeof(LogRecordHeader) + sizeof(LogFooter) <= end) {
+      const auto *rh = reinterpret_cast<const LogRecordHeader *>(base + hdr->footer_offset);
+      const char *payload = reinterpret_cast<const char *>(rh + 1);
+      if (rh->type == LOG_FOOTER && hdr->footer_offset + sizeof(LogRecordHeader) + rh->length <= end
+          && HashBytes(payload, rh->length) == rh->checksum) {
+        const auto *footer = reinterpret_cast<const LogFooter *>(payload);
+        index = reinterpret_cast<const LogIndexEntry *>(footer + 1);
+        n = footer->index_entries;
+      }
+    }
+
+    if (index != nullptr) {
+      indexer.resume(index, n);
+      indexer.entries.assign(index, index + n);
+    }
+    else {
+      // (an empty unsealed segment is just the recorder's spare)
+      if (hdr->committed > sizeof(LogSegmentHeader)) {
+        unsealed++;
+      }
+      indexer.entries.clear();
+      Record r;
+      while (nextInSegment(r)) {
+        indexer.add(r.type, r.time, record_pos, r.data, r.length);
+      }
+    }
+
+    for (const LogIndexEntry &e : indexer.entries) {
+      (e.kind == INDEX_CHECKPOINT ? checkpoint_list : mark_list).push_back(e);
+    }
+  }
+  return true;
+}
+
+void LogReader::closeSegment()
+{
+  if (base != nullptr) {
+    munmap(const_cast<char *>(base), size);
+  }
+  base = nullptr;
+  size = end = pos = 0;
+}
+
+void LogReader::close()
+{
+  closeSegment();
+}
+
+bool LogReader::seek(uint64_t p)
+{
+  uint64_t seq = LogPosSequence(p);
+  if (seq < first_sequence || seq - first_sequence >= files.size()) {
+    return false;
+  }
+  size_t index = seq - first_sequence;
+  if (base == nullptr || index != file_index) {
+    if (!openSegment(index)) {
+      return false;
+    }
+  }
+  uint64_t offset = LogPosOffset(p);
+  if (offset < sizeof(LogSegmentHeader) || offset > end) {
+    return false;
+  }
+  pos = offset;
+  return true;
+}
+
+const LogIndexEntry *LogReader::seekTime(double t)
+{
+  if (checkpoint_list.empty()) {
+    return nullptr;
+  }
+  auto it = std::upper_bound(checkpoint_list.begin(),
+                             checkpoint_list.end(),
+                             t,
+                             [](double t, const LogIndexEntry &e) { return t < e.time; });
+  if (it != checkpoint_list.begin()) {
+    --it;
+  }
+  return seek(it->pos) ? &*it : nullptr;
+}
+
+bool LogReader::nextInSegment(Record &r)
+{
+  while (base != nullptr && pos + sizeof(LogRecordHeader) <= end) {
+    const auto *rh = reinterpret_cast<const LogRecordHeader *>(base + pos);
+    uint64_t next_pos = pos + padded(sizeof(LogRecordHeader) + rh->length);
+    const char *data = reinterpret_cast<const char *>(rh + 1);
+
+    if (next_pos > end || HashBytes(data, rh->length) != rh->checksum) {
+      bad_records++;
+      pos = end;
+      return false;
+    }
+    record_pos = LogPos(first_sequence + file_index, pos);
+    pos = next_pos;
+
+    if (rh->type == LOG_FOOTER) {
+      pos = end;
+      return false;
+    }
+
+    r.type = static_cast<LogRecordType>(rh->type);
+    r.port = rh->port;
+    r.time = rh->time;
+    r.data = data;
+    r.length = rh->length;
+    return true;
+  }
+  return false;
+}
+
+bool LogReader::next(Record &r)
+{
+  while (!nextInSegment(r)) {
+    // this segment is done; move on to the next one
+    if (file_index + 1 >= files.size() || !openSegment(file_index + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Flight recorder log: raw received datagrams with their arrival times,
+// appended to preallocated, memory-mapped segment files
+// <prefix>.NNNNNN.arlog. A recorder opened on a prefix that already has
+// segments continues after the newest of them, so a restart extends the
+// recording instead of overwriting its start.
+//
+// Segment layout: a LogSegmentHeader, then records (LogRecordHeader plus
+// payload, each padded to 8 bytes), then, if the segment was closed
+// cleanly, a LOG_FOOTER record holding the segment's index. The header's
+// committed field is advanced after every complete record, so after a crash
+// everything up to it is still readable (the mapped pages belong to the
+// kernel page cache); the per-record checksums catch anything torn, and the
+// index of an unfinished segment is rebuilt by scanning it.
+//
+// The index is sparse: a checkpoint every CheckpointInterval seconds (with
+// the positions of the latest referee and geometry packets, so replay can
+// start there with full state), plus an entry for every referee stage or
+// command change and every autoref event that fired.
+
+enum LogRecordType : uint16_t
+{
+  LOG_VISION = 1,    // SSL_WrapperPacket carrying a detection frame
+  LOG_GEOMETRY = 2,  // SSL_WrapperPacket carrying only geometry
+  LOG_REFEREE = 3,   // SSL_Referee
+  LOG_EVENT = 4,     // autoref event fired: LogEventMark followed by the name
+  LOG_FOOTER = 0xffff,
+};
+
+static const uint32_t LogMagic = 0x474c5241;  // "ARLG"
+static const uint32_t LogVersion = 2;
+
+// position of a record anywhere in a recording: the segment sequence number
+// in the top 24 bits, the offset in the segment in the low 40
+inline uint64_t LogPos(uint64_t sequence, uint64_t offset)
+{
+  return (sequence << 40) | offset;
+}
+inline uint64_t LogPosSequence(uint64_t pos)
+{
+  return pos >> 40;
+}
+inline uint64_t LogPosOffset(uint64_t pos)
+{
+  return pos & ((1ULL << 40) - 1);
+}
+
+struct LogSegmentHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t segment_size;
+  uint64_t sequence;
+
+  // end offset of the last complete record
+  uint64_t committed;
+  // nonzero once the footer has been written
+  uint64_t sealed;
+  // offset of the footer record, once sealed
+  uint64_t footer_offset;
+
+  uint8_t reserved[16];
+};
+static_assert(sizeof(LogSegmentHeader) == 64, "segment header layout");
+
+struct LogRecordHeader
+{
+  uint16_t type;
+  // UDP source port of the datagram
+  uint16_t port;
+  // payload length in bytes
+  uint32_t length;
+  // arrival time, in seconds
+  double time;
+  // HashBytes of the payload
+  uint64_t checksum;
+};
+static_assert(sizeof(LogRecordHeader) == 24, "record header layout");
+
+// payload of a LOG_EVENT record, before the event name
+struct LogEventMark
+{
+  // capture time of the world the event fired on
+  double capture_time;
+};
+
+enum LogIndexKind : uint16_t
+{
+  INDEX_CHECKPOINT = 1,
+  INDEX_STAGE = 2,
+  INDEX_COMMAND = 3,
+  INDEX_EVENT = 4,
+};
+
+struct LogIndexEntry
+{
+  uint16_t kind;
+  // the new stage or command, for INDEX_STAGE and INDEX_COMMAND
+  uint16_t value;
+  uint32_t reserved;
+  double time;
+  // the record this entry refers to (for a checkpoint, the next record)
+  uint64_t pos;
+  // for a checkpoint: the latest referee and geometry records before pos,
+  // or 0 if there are none
+  uint64_t referee_pos;
+  uint64_t geometry_pos;
+};
+static_assert(sizeof(LogIndexEntry) == 40, "index entry layout");
+
+// payload of the LOG_FOOTER record, followed by index_entries LogIndexEntry
+struct LogFooter
+{
+  uint64_t records;
+  double first_time;
+  double last_time;
+  uint64_t index_entries;
+};
+
+// Builds the index from the sequence of records; used by the recorder as it
+// writes, and by the reader for segments that have no footer.
+class LogIndexer
+{
+  double next_checkpoint;
+  uint64_t referee_pos, geometry_pos;
+  int stage, command;
+
+  void push(LogIndexKind kind, int value, double time, uint64_t pos);
+
+public:
+  static constexpr double CheckpointInterval = 1.0;
+
+  // entries of the current segment
+  std::vector<LogIndexEntry> entries;
+
+  LogIndexer();
+
+  // forget everything
+  void reset();
+
+  // call for each record, in order, before it is written at pos; entries
+  // may be added
+  void add(LogRecordType type, double time, uint64_t pos, const void *data, uint32_t length);
+
+  // continue after a segment whose index was read from its footer
+  void resume(const LogIndexEntry *index, size_t n);
+};
+
+class FlightRecorder
+{
+public:
+  static const uint64_t DefaultSegmentSize = 256ULL << 20;
+
+private:
+  struct Segment
+  {
+    int fd;
+    char *base;
+    uint64_t sequence;
+
+    Segment() : fd(-1), base(nullptr), sequence(0)
+    {
+    }
+  };
+
+  std::string prefix;
+  uint64_t segment_size;
+  int max_segments;
+
+  // segment being written
+  Segment current;
+
+  // The helper thread creates the next segment while this one is written,
+  // and releases the segment given up by a rotation (and deletes the oldest
+  // one, with max_segments), so that rotating only swaps them under the
+  // mutex. A rotation due before the spare is ready drops its record, and
+  // if making the spare failed, asks the helper to try again.
+  std::thread helper;
+  std::mutex mutex;
+  std::condition_variable wake;
+  Segment spare;
+  // segment to release, with the bytes of it to keep, and the sequence
+  // number of the next spare to create; work_pending stays set until the
+  // helper is done with them
+  Segment retired;
+  uint64_t retired_bytes;
+  uint64_t next_sequence;
+  bool work_pending;
+  bool stopping;
+
+  uint64_t pos;
+  uint64_t segment_records;
+  double first_time, last_time;
+
+  uint64_t total_records;
+  uint64_t dropped;
+  uint64_t rotations;
+
+  LogIndexer indexer;
+
+  // space to keep free at the end of the segment for the footer, if the
+  // index grows by extra entries
+  uint64_t footerSpace(size_t extra) const;
+
+  // errors are printed if report
+  bool createSegment(Segment &seg, uint64_t sequence, bool report);
+  void releaseSegment(Segment &seg, uint64_t keep_bytes);
+  void seal();
+  bool rotate();
+  void help();
+
+public:
+  FlightRecorder();
+  ~FlightRecorder();
+
+  // max_segments > 0 deletes the oldest segments so at most that many remain
+  bool open(const char *prefix_, uint64_t segment_size_ = DefaultSegmentSize, int max_segments_ = 0);
+  void close();
+  bool isOpen() const
+  {
+    return current.base != nullptr;
+  }
+
+  // sequence number of the segment being written
+  uint64_t sequence() const
+  {
+    return current.sequence;
+  }
+
+  // Append one record. This only stores into the mapping (no syscalls); when
+  // the segment is full, it also seals it, takes the spare and wakes the
+  // helper.
+  bool append(LogRecordType type, uint16_t port, double time, const void *data, uint32_t length);
+
+  uint64_t recordCount() const
+  {
+    return total_records;
+  }
+  uint64_t droppedCount() const
+  {
+    return dropped;
+  }
+  uint64_t rotationCount() const
+  {
+    return rotations;
+  }
+
+  static std::string segmentName(const std::string &prefix, uint64_t sequence);
+
+  // sequence numbers of the segments of prefix on disk, in order
+  static std::vector<uint64_t> segmentSequences(const std::string &prefix);
+};
+
+// Reads the records of one segment file, or of all segments of a prefix,
+// in order or starting from any indexed position.
+class LogReader
+{
+public:
+  struct Record
+  {
+    LogRecordType type;
+    uint16_t port;
+    double time;
+    const char *data;
+    uint32_t length;
+  };
+
+private:
+  std::vector<std::string> files;
+  uint64_t first_sequence;
+  size_t file_index;
+
+  const char *base;
+  uint64_t size;
+  uint64_t end;
+  uint64_t pos;
+  uint64_t record_pos;
+
+  uint64_t unsealed;
+  uint64_t bad_records;
+
+  std::vector<LogIndexEntry> checkpoint_list, mark_list;
+
+  bool openSegment(size_t index);
+  void closeSegment();
+  bool loadIndex();
+  bool nextInSegment(Record &r);
+
+public:
+  LogReader();
+  ~LogReader();
+
+  // path is either a segment file or a prefix given to FlightRecorder::open
+  bool open(const char *path);
+  void close();
+
+  bool next(Record &r);
+
+  // position of the record last returned by next
+  uint64_t recordPos() const
+  {
+    return record_pos;
+  }
+
+  // continue reading at a position taken from the index or recordPos
+  bool seek(uint64_t p);
+
+  // seek to the last checkpoint at or before time t (or the first one, if t
+  // is earlier than that); returns it, or nullptr if there is none
+  const LogIndexEntry *seekTime(double t);
+
+  // index of the whole recording, in time order
+  const std::vector<LogIndexEntry> &checkpoints() const
+  {
+    return checkpoint_list;
+  }
+  // stage, command and event entries
+  const std::vector<LogIndexEntry> &marks() const
+  {
+    return mark_list;
+  }
+
+  // number of segments that had no footer (recorder did not close cleanly)
+  uint64_t unsealedCount() const
+  {
+    return unsealed;
+  }
+  // number of records whose checksum did not match (reading of that segment
+  // stops there)
+  uint64_t badRecordCount() const
+  {
+    return bad_records;
+  }
+};
@@ -2,7 +2,7 @@
 
 #include <cmath>
 
-#include "constants.h"
+#include "field_model.h"
 #include "gvector.h"
 
 // returns distance from point p to line x0-x1
@@ -592,15 +592,5 @@ vector LineMidpointAngular(const vector &p0, const vector &p1, real &dist)
 template <class vector>
 double DistToDefenseArea(const vector &loc, bool positive_x)
 {
-  auto x = loc.x * (positive_x ? 1 : -1), y = std::abs(loc.y);
-
-  if (y < Constants::DefenseWidthH) {
-    return std::abs(x - Constants::FieldLengthH + Constants::DefenseLength);
-  }
-
-  if (x > Constants::FieldLengthH - Constants::DefenseLength) {
-    return y - Constants::DefenseWidthH;
-  }
-
-  return std::hypot(x - Constants::FieldLengthH + Constants::DefenseLength, y - Constants::DefenseWidthH);
+  return FieldModel::get().defenseDist(vector2f(loc.x, loc.y), positive_x);
 }
@@ -67,13 +67,6 @@ public:
     x = y = 0;
   }
 
-  /// copy constructor
-  vector2d<num> &operator=(vector2d<num> p)
-  {
-    set(p);
-    return (*this);
-  }
-
   /// element accessor
   num &operator[](int idx)
   {
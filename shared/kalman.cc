@@ -0,0 +1,151 @@
+#include "kalman.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr double BallFilter::Friction;
+constexpr double BallFilter::AccelNoise;
+constexpr double BallFilter::MeasurementVar;
+constexpr double BallFilter::InitialVelVar;
+constexpr double BallFilter::Gate;
+constexpr double BallFilter::ManeuverGate;
+constexpr double BallFilter::ManeuverInflation;
+constexpr double BallFilter::MinRestartSpan;
+constexpr double BallFilter::LostTime;
+
+static double measurementVar(float conf)
+{
+  return BallFilter::MeasurementVar / std::max(conf, .05f);
+}
+
+void BallFilter::reset()
+{
+  valid = false;
+  t = 0;
+  p = v = vector2d<double>(0, 0);
+  pp = pv = vv = 0;
+  rejected.clear();
+  update_count = reject_count = reset_count = 0;
+}
+
+void BallFilter::restart(double time, vector2d<double> z, vector2d<double> vel, double r)
+{
+  valid = true;
+  t = time;
+  p = z;
+  v = vel;
+  pp = r;
+  pv = 0;
+  vv = InitialVelVar;
+  rejected.clear();
+  reset_count++;
+}
+
+void BallFilter::predict(double dt)
+{
+  // x' = F x with F = [1 b; 0 a]
+  double a = exp(-Friction * dt);
+  double b = (1 - a) / Friction;
+
+  p += v * b;
+  v *= a;
+
+  double q = AccelNoise;
+  double dt2 = dt * dt;
+  double pp_ = pp + 2 * b * pv + b * b * vv + q * dt2 * dt / 3;
+  double pv_ = a * (pv + b * vv) + q * dt2 / 2;
+  double vv_ = a * a * vv + q * dt;
+  pp = pp_;
+  pv = pv_;
+  vv = vv_;
+  t += dt;
+}
+
+double BallFilter::gateDistance(double time, vector2f z, float conf) const
+{
+  if (!valid) {
+    return 0;
+  }
+  double dt = time - t;
+  double b = (dt > 0) ? (1 - exp(-Friction * dt)) / Friction : dt;
+  vector2d<double> predicted = p + v * b;
+  double s = pp + 2 * std::max(dt, 0.) * pv + dt * dt * vv + measurementVar(conf);
+  vector2d<double> y(z.x - predicted.x, z.y - predicted.y);
+  return y.sqlength() / s;
+}
+
+bool BallFilter::update(double time, vector2f z, float conf)
+{
+  vector2d<double> zd(z.x, z.y);
+  double r = measurementVar(conf);
+
+  if (!valid || time - t > LostTime) {
+    restart(time, zd, vector2d<double>(0, 0), r);
+    return true;
+  }
+
+  double dt = time - t;
+  if (dt > 0) {
+    predict(dt);
+  }
+  else {
+    // a slightly older detection from another camera: move it to the
+    // filter's time instead of going back
+    zd -= v * dt;
+  }
+
+  vector2d<double> y = zd - p;
+  double s = pp + r;
+  double d2 = y.sqlength() / s;
+
+  if (d2 > Gate) {
+    reject_count++;
+    // consistent detections far from the track mean the track is wrong
+    // (e.g., the ball was moved); restart from them
+    // (zd is now at the filter's time, t)
+    rejected.add(t, vector2f(zd.x, zd.y));
+    if (rejected.full()) {
+      vector2d<double> vel(0, 0);
+      if (rejected[0].t - rejected[-MaxRejects + 1].t >= MinRestartSpan) {
+        vector2f fitted = rejected.velocity();
+        vel.set(fitted.x, fitted.y);
+      }
+      restart(time, zd, vel, r);
+      return true;
+    }
+    return false;
+  }
+  rejected.clear();
+
+  if (d2 > ManeuverGate) {
+    pp *= ManeuverInflation;
+    pv *= ManeuverInflation;
+    vv *= ManeuverInflation;
+    s = pp + r;
+  }
+
+  double k0 = pp / s;
+  double k1 = pv / s;
+  p += y * k0;
+  v += y * k1;
+
+  vv -= k1 * pv;
+  pv *= (1 - k0);
+  pp *= (1 - k0);
+
+  update_count++;
+  return true;
+}
+
+vector2f BallFilter::loc(double time) const
+{
+  double dt = std::max(time - t, 0.);
+  double b = (1 - exp(-Friction * dt)) / Friction;
+  return vector2f(p.x + v.x * b, p.y + v.y * b);
+}
+
+vector2f BallFilter::vel(double time) const
+{
+  double a = exp(-Friction * std::max(time - t, 0.));
+  return vector2f(v.x * a, v.y * a);
+}
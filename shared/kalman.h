@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gvector.h"
+#include "linear_fit.h"
+
+// Ball filter: constant velocity with rolling friction (velocity decays
+// exponentially), fusing the detections of every camera, each applied at its
+// own capture time and weighted by its confidence.
+//
+// Measurement and process noise are the same for both axes, so the two axes
+// share one 2x2 (position, velocity) covariance; only the states differ.
+class BallFilter
+{
+public:
+  // rate at which a rolling ball's velocity decays (1/s)
+  static constexpr double Friction = 0.4;
+  // spectral density of the acceleration noise ((mm/s^2)^2 s)
+  static constexpr double AccelNoise = 1e6;
+  // variance of a detection with confidence 1 (mm^2), including the
+  // calibration mismatch between overlapping cameras
+  static constexpr double MeasurementVar = 100;
+  // velocity variance of a newly acquired ball ((mm/s)^2)
+  static constexpr double InitialVelVar = 4e6;
+
+  // squared Mahalanobis distance beyond which a detection is rejected
+  static constexpr double Gate = 36;
+  // above this distance, the ball is assumed to have been kicked or
+  // deflected, and the covariance is inflated so the filter follows quickly
+  static constexpr double ManeuverGate = 6;
+  static constexpr double ManeuverInflation = 30;
+  // restart the filter after this many rejected detections in a row, with
+  // the velocity fitted to them if they span at least this long (about a
+  // camera frame; detections closer together are mostly from overlapping
+  // cameras, whose calibration mismatch would pass for a fast ball) and at
+  // rest otherwise
+  static const int MaxRejects = 3;
+  static constexpr double MinRestartSpan = 1 / 60.;
+  // consider the ball lost after this long without detections (s)
+  static constexpr double LostTime = 0.5;
+
+private:
+  bool valid;
+  double t;
+  vector2d<double> p, v;
+  // covariance: position, position-velocity, velocity (per axis)
+  double pp, pv, vv;
+
+  // the detections rejected in a row since the last one used
+  LinearFit<MaxRejects> rejected;
+
+  uint64_t update_count, reject_count, reset_count;
+
+  void predict(double dt);
+  void restart(double time, vector2d<double> z, vector2d<double> vel, double r);
+
+public:
+  BallFilter()
+  {
+    reset();
+  }
+
+  void reset();
+
+  bool isValid(double now) const
+  {
+    return valid && now - t < LostTime;
+  }
+
+  // squared Mahalanobis distance of a detection from the predicted ball
+  // position (0 if the filter is not running)
+  double gateDistance(double time, vector2f z, float conf) const;
+
+  // add a detection; returns whether it was used
+  bool update(double time, vector2f z, float conf);
+
+  // state extrapolated to the given time
+  vector2f loc(double time) const;
+  vector2f vel(double time) const;
+
+  // per-axis variances of the current state (mm^2, (mm/s)^2)
+  double locVar() const
+  {
+    return pp;
+  }
+  double velVar() const
+  {
+    return vv;
+  }
+
+  double time() const
+  {
+    return t;
+  }
+  uint64_t updateCount() const
+  {
+    return update_count;
+  }
+  uint64_t rejectCount() const
+  {
+    return reject_count;
+  }
+  uint64_t resetCount() const
+  {
+    return reset_count;
+  }
+};
@@ -0,0 +1,97 @@
+#include "latency.h"
+
+#include <chrono>
+#include <thread>
+
+double CyclesPerNs()
+{
+  static double cycles_per_ns = []() {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = CycleCount();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t c1 = CycleCount();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    return (ns > 0 && c1 > c0) ? (c1 - c0) / ns : 1;
+  }();
+  return cycles_per_ns;
+}
+
+LatencyHistogram &LatencyHistogram::operator=(const LatencyHistogram &other)
+{
+  for (int b = 0; b < NumBuckets; b++) {
+    counts[b].store(other.counts[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+  total.store(other.total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  max_cycles.store(other.max_cycles.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  return *this;
+}
+
+void LatencyHistogram::clear()
+{
+  for (auto &c : counts) {
+    c.store(0, std::memory_order_relaxed);
+  }
+  total.store(0, std::memory_order_relaxed);
+  max_cycles.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::bucketTop(int b)
+{
+  if (b < (1 << SubBits)) {
+    return b;
+  }
+  int shift = (b >> SubBits) - 1;
+  uint64_t mantissa = (1 << SubBits) | (b & ((1 << SubBits) - 1));
+  return ((mantissa + 1) << shift) - 1;
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+  uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+
+  // the rank of the value wanted, counting from 1
+  uint64_t rank = static_cast<uint64_t>(p * n);
+  if (rank < p * n || rank == 0) {
+    rank++;
+  }
+
+  uint64_t seen = 0;
+  uint64_t top = 0;
+  for (int b = 0; b < NumBuckets && seen < rank; b++) {
+    uint64_t c = counts[b].load(std::memory_order_relaxed);
+    if (c > 0) {
+      seen += c;
+      top = bucketTop(b);
+    }
+  }
+
+  // (a bucket's top can be past anything actually recorded)
+  uint64_t max = max_cycles.load(std::memory_order_relaxed);
+  return (top < max ? top : max) / CyclesPerNs();
+}
+
+double LatencyHistogram::max() const
+{
+  return max_cycles.load(std::memory_order_relaxed) / CyclesPerNs();
+}
+
+void PrintLatencyHeader(FILE *f)
+{
+  fprintf(f, "%-50s %10s %9s %9s %9s %9s\n", "stage (us)", "count", "p50", "p99", "p999", "max");
+}
+
+void PrintLatency(FILE *f, const char *stage, const LatencyHistogram &h)
+{
+  fprintf(f,
+          "%-50s %10lu %9.2f %9.2f %9.2f %9.2f\n",
+          stage,
+          h.count(),
+          h.percentile(.5) / 1000,
+          h.percentile(.99) / 1000,
+          h.percentile(.999) / 1000,
+          h.max() / 1000);
+}
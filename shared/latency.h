@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Cheap timing of short sections of code, meant to stay enabled in
+// production: a probe is two reads of the cycle counter plus one histogram
+// update (see bench/latency_bench.cc).
+
+// the CPU's time-stamp counter (nanoseconds where there is none)
+inline uint64_t CycleCount()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+#endif
+}
+
+// CycleCount ticks per nanosecond, measured on first use (which takes about
+// 20 ms)
+double CyclesPerNs();
+
+// Counts of durations in CycleCount ticks, HDR-style: each power of two is
+// split into 2^SubBits linear buckets, so any value is known to within 1/16
+// of itself while the whole histogram is a few kilobytes. Only one thread
+// may record at a time, but any thread can read while it does.
+class LatencyHistogram
+{
+public:
+  static const int SubBits = 4;
+  static const int MaxBits = 48;
+  static const int NumBuckets = (MaxBits - SubBits + 1) << SubBits;
+
+  LatencyHistogram()
+  {
+    clear();
+  }
+  LatencyHistogram(const LatencyHistogram &other)
+  {
+    *this = other;
+  }
+  LatencyHistogram &operator=(const LatencyHistogram &other);
+
+  void clear();
+
+  void record(uint64_t cycles)
+  {
+    int b = bucket(cycles);
+    bump(counts[b], 1);
+    bump(total, 1);
+    if (cycles > max_cycles.load(std::memory_order_relaxed)) {
+      max_cycles.store(cycles, std::memory_order_relaxed);
+    }
+  }
+
+  // for durations measured some other way; negative ones count as 0
+  void recordSeconds(double s)
+  {
+    record(s > 0 ? static_cast<uint64_t>(s * 1e9 * CyclesPerNs()) : 0);
+  }
+
+  uint64_t count() const
+  {
+    return total.load(std::memory_order_relaxed);
+  }
+
+  // the smallest duration (ns) that at least fraction p of the recorded
+  // durations do not exceed, to the histogram's precision
+  double percentile(double p) const;
+  double max() const;
+
+private:
+  std::atomic<uint64_t> counts[NumBuckets];
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> max_cycles;
+
+  static void bump(std::atomic<uint64_t> &c, uint64_t n)
+  {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  static int bucket(uint64_t v)
+  {
+    if (v < (uint64_t(1) << SubBits)) {
+      return v;
+    }
+    if (v >= (uint64_t(1) << MaxBits)) {
+      return NumBuckets - 1;
+    }
+    int shift = 63 - __builtin_clzll(v) - SubBits;
+    return ((shift + 1) << SubBits) + ((v >> shift) & ((1 << SubBits) - 1));
+  }
+
+  // the largest value that falls in bucket b
+  static uint64_t bucketTop(int b);
+};
+
+// records the time from its construction to its destruction
+class LatencyProbe
+{
+  LatencyHistogram &hist;
+  uint64_t start;
+
+public:
+  explicit LatencyProbe(LatencyHistogram &h) : hist(h), start(CycleCount())
+  {
+  }
+  ~LatencyProbe()
+  {
+    hist.record(CycleCount() - start);
+  }
+};
+
+// a table of histograms, one line each: a header, then one line per stage
+void PrintLatencyHeader(FILE *f);
+void PrintLatency(FILE *f, const char *stage, const LatencyHistogram &h);
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "gvector.h"
+#include "util.h"
+
+// A least-squares fit of loc = p + v * t to the last (up to) N samples added,
+// kept as running sums, so that adding a sample (which drops the oldest once
+// there are N) and removing the oldest are both O(1). Samples are indexed
+// like WorldHistory: 0 is the newest and -size() + 1 the oldest.
+//
+// Times are summed relative to a reference time rather than as they are, so
+// that squaring match timestamps does not cost the fit its precision. Every
+// N samples, the reference is moved up to the oldest sample and the sums are
+// recomputed from the samples, which also discards the rounding error that
+// subtracting dropped samples leaves behind.
+template <int N>
+class LinearFit
+{
+public:
+  LinearFit()
+  {
+    clear();
+  }
+
+  void clear()
+  {
+    newest = N - 1;
+    num = 0;
+    since_rebase = 0;
+    t_ref = 0;
+    zeroSums();
+  }
+
+  // adds a sample newer than (or as old as) the others
+  void add(double t, vector2f loc)
+  {
+    if (num == 0) {
+      t_ref = t;
+    }
+    if (num == N) {
+      accumulate((*this)[-N + 1], -1);
+    }
+    else {
+      num++;
+    }
+    newest = (newest + 1) % N;
+    samples[newest] = tvec(t, loc);
+    accumulate(samples[newest], 1);
+
+    if (++since_rebase >= N) {
+      rebase();
+    }
+  }
+
+  void removeOldest()
+  {
+    if (num > 0) {
+      accumulate((*this)[-num + 1], -1);
+      num--;
+    }
+  }
+
+  int size() const
+  {
+    return num;
+  }
+  bool full() const
+  {
+    return num == N;
+  }
+  const tvec &operator[](int i) const
+  {
+    return samples[(newest + i + N) % N];
+  }
+
+  // the fitted velocity; 0 unless there are samples at two different times
+  vector2f velocity() const
+  {
+    double vx, vy;
+    slopes(vx, vy);
+    return vector2f(vx, vy);
+  }
+
+  // the fitted location at time t (there must be a sample)
+  vector2f position(double t) const
+  {
+    double vx, vy;
+    slopes(vx, vy);
+    double dt = t - t_ref;
+    return vector2f((sx - st * vx) / num + vx * dt, (sy - st * vy) / num + vy * dt);
+  }
+
+  // the RMS distance of the samples from the fitted locations at their times
+  double residual() const
+  {
+    if (num == 0) {
+      return 0;
+    }
+    double vx, vy;
+    slopes(vx, vy);
+    double px = (sx - st * vx) / num, py = (sy - st * vy) / num;
+
+    // sum of (x - px - vx * t)^2 over the samples, expanded into the sums
+    double ex = sxx - 2 * px * sx - 2 * vx * stx + num * px * px + 2 * px * vx * st + vx * vx * stt;
+    double ey = syy - 2 * py * sy - 2 * vy * sty + num * py * py + 2 * py * vy * st + vy * vy * stt;
+    return sqrt(std::max(0.0, (ex + ey) / num));
+  }
+
+private:
+  tvec samples[N];
+  int newest, num;
+
+  // samples added since the sums were last recomputed
+  int since_rebase;
+
+  // sums over the samples of t (relative to t_ref), x, y, and their
+  // products
+  double t_ref;
+  double st, stt, sx, sy, stx, sty, sxx, syy;
+
+  void zeroSums()
+  {
+    st = stt = sx = sy = stx = sty = sxx = syy = 0;
+  }
+
+  void accumulate(const tvec &s, double sign)
+  {
+    double t = s.t - t_ref, x = s.v.x, y = s.v.y;
+    st += sign * t;
+    stt += sign * t * t;
+    sx += sign * x;
+    sy += sign * y;
+    stx += sign * t * x;
+    sty += sign * t * y;
+    sxx += sign * x * x;
+    syy += sign * y * y;
+  }
+
+  void rebase()
+  {
+    t_ref = (*this)[-num + 1].t;
+    zeroSums();
+    for (int i = -num + 1; i <= 0; i++) {
+      accumulate((*this)[i], 1);
+    }
+    since_rebase = 0;
+  }
+
+  void slopes(double &vx, double &vy) const
+  {
+    double d = num * stt - st * st;
+    if (num < 2 || d <= 0) {
+      vx = vy = 0;
+      return;
+    }
+    vx = (num * stx - st * sx) / d;
+    vy = (num * sty - st * sy) / d;
+  }
+};
@@ -0,0 +1,151 @@
+#include "reactor.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static const int MaxReadyEvents = 16;
+
+Reactor::Reactor() : deadline(0)
+{
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (epoll_fd < 0 || timer_fd < 0) {
+    fprintf(stderr, "ERROR CREATING EVENT LOOP: %s\n", strerror(errno));
+    return;
+  }
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = timer_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+}
+
+Reactor::~Reactor()
+{
+  for (int fd : periodic_fds) {
+    close(fd);
+  }
+  if (timer_fd >= 0) {
+    close(timer_fd);
+  }
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+  }
+}
+
+bool Reactor::add(int fd, uint32_t events, Handler h)
+{
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    return false;
+  }
+  handlers[fd] = h;
+  return true;
+}
+
+bool Reactor::modify(int fd, uint32_t events)
+{
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void Reactor::remove(int fd)
+{
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  handlers.erase(fd);
+}
+
+void Reactor::setDeadline(double t)
+{
+  if (t == deadline) {
+    return;
+  }
+  deadline = t;
+
+  itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (t > 0) {
+    double sec = floor(t);
+    spec.it_value.tv_sec = static_cast<time_t>(sec);
+    spec.it_value.tv_nsec = static_cast<long>((t - sec) * 1e9);
+    // an all-zero value would disarm the timer instead of firing at once
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+      spec.it_value.tv_nsec = 1;
+    }
+  }
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+bool Reactor::addPeriodic(double interval, std::function<void()> h)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  double sec = floor(interval);
+  spec.it_interval.tv_sec = static_cast<time_t>(sec);
+  spec.it_interval.tv_nsec = static_cast<long>((interval - sec) * 1e9);
+  if (spec.it_interval.tv_sec == 0 && spec.it_interval.tv_nsec == 0) {
+    spec.it_interval.tv_nsec = 1;
+  }
+  spec.it_value = spec.it_interval;
+
+  if (timerfd_settime(fd, 0, &spec, nullptr) != 0 || !add(fd, EPOLLIN, [fd, h](uint32_t) {
+        uint64_t expirations;
+        while (read(fd, &expirations, sizeof(expirations)) > 0) {
+        }
+        h();
+      })) {
+    close(fd);
+    return false;
+  }
+  periodic_fds.push_back(fd);
+  return true;
+}
+
+bool Reactor::runOnce(int timeout_ms)
+{
+  epoll_event ready[MaxReadyEvents];
+  int n = epoll_wait(epoll_fd, ready, MaxReadyEvents, timeout_ms);
+  if (n < 0) {
+    return errno == EINTR;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int fd = ready[i].data.fd;
+    if (fd == timer_fd) {
+      uint64_t expirations;
+      while (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+      }
+      deadline = 0;
+      if (deadline_handler) {
+        deadline_handler();
+      }
+      continue;
+    }
+
+    auto it = handlers.find(fd);
+    if (it != handlers.end()) {
+      // copy, in case the handler removes itself
+      Handler h = it->second;
+      h(ready[i].events);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include <sys/epoll.h>
+
+// Single-threaded epoll event loop with one absolute deadline timer (a
+// CLOCK_REALTIME timerfd) and any number of periodic timers. File descriptors are registered with a callback
+// that receives the ready epoll events; the deadline callback runs when the
+// wall clock passes the armed time. Nothing runs, and the loop sleeps, while
+// no descriptor is ready and no deadline is armed.
+class Reactor
+{
+public:
+  typedef std::function<void(uint32_t events)> Handler;
+
+private:
+  int epoll_fd;
+  int timer_fd;
+
+  std::map<int, Handler> handlers;
+  std::function<void()> deadline_handler;
+
+  // currently armed deadline in seconds, or 0 if none
+  double deadline;
+
+  // the periodic timers' timerfds, closed with the reactor
+  std::vector<int> periodic_fds;
+
+public:
+  Reactor();
+  ~Reactor();
+
+  bool isOpen() const
+  {
+    return epoll_fd >= 0 && timer_fd >= 0;
+  }
+
+  bool add(int fd, uint32_t events, Handler h);
+  bool modify(int fd, uint32_t events);
+  void remove(int fd);
+
+  // arm the timer to run the deadline handler at the given wall-clock time
+  // (seconds since the epoch); a time <= 0 disarms it
+  void setDeadline(double t);
+  void onDeadline(std::function<void()> h)
+  {
+    deadline_handler = h;
+  }
+  double getDeadline() const
+  {
+    return deadline;
+  }
+
+  // run h every interval seconds (of monotonic time) for as long as the
+  // reactor runs; expirations missed while the loop was busy are merged into
+  // one call. Returns false if the timer could not be set up.
+  bool addPeriodic(double interval, std::function<void()> h);
+
+  // wait for and dispatch one round of ready descriptors; returns false on
+  // an unrecoverable error
+  bool runOnce(int timeout_ms = -1);
+};
@@ -0,0 +1,224 @@
+#include "robot_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "field_model.h"
+
+// SSE2 is part of x86-64, so only AVX2 needs checking for at run time
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define GEOMETRY_X86 1
+#endif
+
+void RobotArrays::load(const RobotSet &robots)
+{
+  for (int s = 0; s < NumSlots; s++) {
+    x[s] = y[s] = 0;
+    cos_a[s] = 1;
+    sin_a[s] = 0;
+  }
+  active = 0;
+  for (const WorldRobot &r : robots) {
+    int s = RobotSet::slot(r.robot_id);
+    x[s] = r.loc.x;
+    y[s] = r.loc.y;
+    double a = -r.angle;
+    cos_a[s] = cos(a);
+    sin_a[s] = sin(a);
+    active |= uint64_t(1) << s;
+  }
+}
+
+namespace
+{
+// The defense area as FieldModel::defenseDist sees it. For a robot at (x, y)
+// on the area's side, with a = x - defense_front (past the front line) and
+// b = |y| - defense_width_h (past the sides), the distance is |a| if b < 0, b
+// if a > 0, and hypot(a, b) otherwise, which is hypot(ea, eb) with
+// ea = (b < 0 ? |a| : max(-a, 0)) and eb = max(b, 0). The hypot is taken in
+// double like hypotf's, and (since a and b are floats) is exact for the two
+// straight cases.
+struct DefenseLimits
+{
+  float front, width_h;
+
+  DefenseLimits(const FieldModel &field) : front(field.defense_front), width_h(field.defense_width_h)
+  {
+  }
+};
+
+void scalarKernel(const RobotArrays &in, vector2f ball, const DefenseLimits &lim, RobotGeometry &out)
+{
+  for (int s = 0; s < RobotArrays::NumSlots; s++) {
+    float dx = in.x[s] - ball.x, dy = in.y[s] - ball.y;
+    out.ball_dist[s] = std::sqrt(dx * dx + dy * dy);
+
+    float ux = ball.x - in.x[s], uy = ball.y - in.y[s];
+    out.ball_local_x[s] = in.cos_a[s] * ux - in.sin_a[s] * uy;
+    out.ball_local_y[s] = in.sin_a[s] * ux + in.cos_a[s] * uy;
+
+    float b = std::fabs(in.y[s]) - lim.width_h;
+    for (int side = 0; side < 2; side++) {
+      float a = (side ? in.x[s] : -in.x[s]) - lim.front;
+      double ea = b < 0 ? std::fabs(a) : std::max(-a, 0.f);
+      double eb = std::max(b, 0.f);
+      out.defense_dist[side][s] = std::sqrt(ea * ea + eb * eb);
+    }
+  }
+}
+
+#ifdef GEOMETRY_X86
+// The double halves of a vector of floats (the low and high half of the
+// robots in it), a vector of floats from two such halves, and the hypot of
+// each pair of lanes.
+inline __m128d lo(__m128 v)
+{
+  return _mm_cvtps_pd(v);
+}
+inline __m128d hi(__m128 v)
+{
+  return _mm_cvtps_pd(_mm_movehl_ps(v, v));
+}
+inline __m128 narrow(__m128d l, __m128d h)
+{
+  return _mm_movelh_ps(_mm_cvtpd_ps(l), _mm_cvtpd_ps(h));
+}
+inline __m128d hypot(__m128d a, __m128d b)
+{
+  return _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(a, a), _mm_mul_pd(b, b)));
+}
+
+void sse2Kernel(const RobotArrays &in, vector2f ball, const DefenseLimits &lim, RobotGeometry &out)
+{
+  const __m128 bx = _mm_set1_ps(ball.x), by = _mm_set1_ps(ball.y);
+  const __m128 sign = _mm_set1_ps(-0.f), zero = _mm_setzero_ps();
+  const __m128 front = _mm_set1_ps(lim.front), width_h = _mm_set1_ps(lim.width_h);
+
+  for (int s = 0; s < RobotArrays::NumSlots; s += 4) {
+    __m128 x = _mm_load_ps(in.x + s), y = _mm_load_ps(in.y + s);
+
+    __m128 dx = _mm_sub_ps(x, bx), dy = _mm_sub_ps(y, by);
+    _mm_store_ps(out.ball_dist + s, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+
+    __m128 ux = _mm_sub_ps(bx, x), uy = _mm_sub_ps(by, y);
+    __m128d c0 = _mm_load_pd(in.cos_a + s), c1 = _mm_load_pd(in.cos_a + s + 2);
+    __m128d s0 = _mm_load_pd(in.sin_a + s), s1 = _mm_load_pd(in.sin_a + s + 2);
+    __m128d ux0 = lo(ux), ux1 = hi(ux), uy0 = lo(uy), uy1 = hi(uy);
+    _mm_store_ps(out.ball_local_x + s,
+                 narrow(_mm_sub_pd(_mm_mul_pd(c0, ux0), _mm_mul_pd(s0, uy0)),
+                        _mm_sub_pd(_mm_mul_pd(c1, ux1), _mm_mul_pd(s1, uy1))));
+    _mm_store_ps(out.ball_local_y + s,
+                 narrow(_mm_add_pd(_mm_mul_pd(s0, ux0), _mm_mul_pd(c0, uy0)),
+                        _mm_add_pd(_mm_mul_pd(s1, ux1), _mm_mul_pd(c1, uy1))));
+
+    __m128 b = _mm_sub_ps(_mm_andnot_ps(sign, y), width_h);
+    __m128 inside = _mm_cmplt_ps(b, zero);
+    __m128 eb = _mm_max_ps(b, zero);
+    __m128d eb0 = lo(eb), eb1 = hi(eb);
+    for (int side = 0; side < 2; side++) {
+      __m128 a = _mm_sub_ps(side ? x : _mm_xor_ps(x, sign), front);
+      __m128 ea = _mm_or_ps(_mm_and_ps(inside, _mm_andnot_ps(sign, a)),
+                            _mm_andnot_ps(inside, _mm_max_ps(_mm_xor_ps(a, sign), zero)));
+      _mm_store_ps(out.defense_dist[side] + s, narrow(hypot(lo(ea), eb0), hypot(hi(ea), eb1)));
+    }
+  }
+}
+
+// the same for AVX2, which is only used where the CPU has it
+#define TARGET_AVX2 __attribute__((target("avx2")))
+TARGET_AVX2 inline __m256d lo(__m256 v)
+{
+  return _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+}
+TARGET_AVX2 inline __m256d hi(__m256 v)
+{
+  return _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+}
+TARGET_AVX2 inline __m256 narrow(__m256d l, __m256d h)
+{
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(l)), _mm256_cvtpd_ps(h), 1);
+}
+TARGET_AVX2 inline __m256d hypot(__m256d a, __m256d b)
+{
+  return _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b)));
+}
+
+TARGET_AVX2 void avx2Kernel(const RobotArrays &in, vector2f ball, const DefenseLimits &lim, RobotGeometry &out)
+{
+  const __m256 bx = _mm256_set1_ps(ball.x), by = _mm256_set1_ps(ball.y);
+  const __m256 sign = _mm256_set1_ps(-0.f), zero = _mm256_setzero_ps();
+  const __m256 front = _mm256_set1_ps(lim.front), width_h = _mm256_set1_ps(lim.width_h);
+
+  for (int s = 0; s < RobotArrays::NumSlots; s += 8) {
+    __m256 x = _mm256_load_ps(in.x + s), y = _mm256_load_ps(in.y + s);
+
+    __m256 dx = _mm256_sub_ps(x, bx), dy = _mm256_sub_ps(y, by);
+    _mm256_store_ps(out.ball_dist + s, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy))));
+
+    __m256 ux = _mm256_sub_ps(bx, x), uy = _mm256_sub_ps(by, y);
+    __m256d c0 = _mm256_load_pd(in.cos_a + s), c1 = _mm256_load_pd(in.cos_a + s + 4);
+    __m256d s0 = _mm256_load_pd(in.sin_a + s), s1 = _mm256_load_pd(in.sin_a + s + 4);
+    __m256d ux0 = lo(ux), ux1 = hi(ux), uy0 = lo(uy), uy1 = hi(uy);
+    _mm256_store_ps(out.ball_local_x + s,
+                    narrow(_mm256_sub_pd(_mm256_mul_pd(c0, ux0), _mm256_mul_pd(s0, uy0)),
+                           _mm256_sub_pd(_mm256_mul_pd(c1, ux1), _mm256_mul_pd(s1, uy1))));
+    _mm256_store_ps(out.ball_local_y + s,
+                    narrow(_mm256_add_pd(_mm256_mul_pd(s0, ux0), _mm256_mul_pd(c0, uy0)),
+                           _mm256_add_pd(_mm256_mul_pd(s1, ux1), _mm256_mul_pd(c1, uy1))));
+
+    __m256 b = _mm256_sub_ps(_mm256_andnot_ps(sign, y), width_h);
+    __m256 inside = _mm256_cmp_ps(b, zero, _CMP_LT_OQ);
+    __m256 eb = _mm256_max_ps(b, zero);
+    __m256d eb0 = lo(eb), eb1 = hi(eb);
+    for (int side = 0; side < 2; side++) {
+      __m256 a = _mm256_sub_ps(side ? x : _mm256_xor_ps(x, sign), front);
+      __m256 ea = _mm256_blendv_ps(_mm256_max_ps(_mm256_xor_ps(a, sign), zero), _mm256_andnot_ps(sign, a), inside);
+      _mm256_store_ps(out.defense_dist[side] + s, narrow(hypot(lo(ea), eb0), hypot(hi(ea), eb1)));
+    }
+  }
+}
+#undef TARGET_AVX2
+#endif
+}
+
+GeometryKernel BestGeometryKernel()
+{
+#ifdef GEOMETRY_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return GeometryKernel::AVX2;
+  }
+  return GeometryKernel::SSE2;
+#else
+  return GeometryKernel::Scalar;
+#endif
+}
+
+const char *GeometryKernelName(GeometryKernel kernel)
+{
+  switch (kernel) {
+    case GeometryKernel::SSE2:
+      return "sse2";
+    case GeometryKernel::AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+void ComputeRobotGeometry(const RobotArrays &robots, vector2f ball, RobotGeometry &out, GeometryKernel kernel)
+{
+  DefenseLimits lim(FieldModel::get());
+  switch (kernel) {
+#ifdef GEOMETRY_X86
+    case GeometryKernel::SSE2:
+      sse2Kernel(robots, ball, lim, out);
+      return;
+    case GeometryKernel::AVX2:
+      avx2Kernel(robots, ball, lim, out);
+      return;
+#endif
+    default:
+      scalarKernel(robots, ball, lim, out);
+  }
+}
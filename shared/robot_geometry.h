@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include "world.h"
+
+// The robots of one World laid out as parallel arrays indexed by RobotSet
+// slot, so that the geometry every rule asks of each robot can be computed
+// for all of them at once with SIMD. Slots without a robot hold a robot at
+// the origin facing along x; their results are computed with the rest and
+// are meaningless.
+struct RobotArrays
+{
+  static const int NumSlots = RobotSet::NumSlots;
+
+  alignas(32) float x[NumSlots];
+  alignas(32) float y[NumSlots];
+
+  // of -angle, in double like vector2d::rotate uses them, so that the
+  // rotated results come out the same
+  alignas(32) double cos_a[NumSlots];
+  alignas(32) double sin_a[NumSlots];
+
+  // bit s set if slot s holds a robot
+  uint64_t active;
+
+  void load(const RobotSet &robots);
+};
+
+// What ComputeRobotGeometry computes, by RobotSet slot. Each value is the
+// same, bit for bit, as the scalar expression it replaces:
+//   ball_dist       (r.loc - ball).length()
+//   ball_local_x/y  (ball - r.loc).rotate(-r.angle)
+//   defense_dist    DistToDefenseArea(r.loc, positive_x), indexed by positive_x
+struct RobotGeometry
+{
+  static const int NumSlots = RobotSet::NumSlots;
+
+  alignas(32) float ball_dist[NumSlots];
+  alignas(32) float ball_local_x[NumSlots];
+  alignas(32) float ball_local_y[NumSlots];
+  alignas(32) float defense_dist[2][NumSlots];
+};
+
+enum class GeometryKernel
+{
+  Scalar,
+  SSE2,
+  AVX2,
+};
+
+// the fastest kernel this CPU can run
+GeometryKernel BestGeometryKernel();
+
+const char *GeometryKernelName(GeometryKernel kernel);
+
+// computes every slot's geometry relative to the ball and the defense areas
+// of this thread's FieldModel in one pass; the kernel must be one the CPU can
+// run (BestGeometryKernel() or below)
+void ComputeRobotGeometry(const RobotArrays &robots, vector2f ball, RobotGeometry &out, GeometryKernel kernel);
+
+inline void ComputeRobotGeometry(const RobotArrays &robots, vector2f ball, RobotGeometry &out)
+{
+  static const GeometryKernel best = BestGeometryKernel();
+  ComputeRobotGeometry(robots, ball, out, best);
+}
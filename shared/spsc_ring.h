@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Slots are preallocated and reused, so a producer can fill a slot in
+// place (e.g., parse a protobuf into it) without any allocation, and the
+// consumer reads it in place before releasing it.
+//
+// Capacity must be a power of two.
+template <class T, const int Capacity>
+class SpscRing
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+  std::vector<T> slots;
+
+  // next slot to be written (owned by the producer)
+  alignas(64) std::atomic<uint32_t> head;
+  // next slot to be read (owned by the consumer)
+  alignas(64) std::atomic<uint32_t> tail;
+
+  // statistics, written only by the producer
+  alignas(64) std::atomic<uint64_t> overflows;
+  std::atomic<uint32_t> high_water;
+
+public:
+  SpscRing() : slots(Capacity), head(0), tail(0), overflows(0), high_water(0)
+  {
+  }
+
+  // producer: get the slot to fill next, or nullptr if the ring is full (in
+  // which case an overflow is counted and the caller should drop the item)
+  T *beginPush()
+  {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= Capacity) {
+      overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &slots[h & (Capacity - 1)];
+  }
+
+  // producer: publish the slot returned by beginPush
+  void commitPush()
+  {
+    uint32_t h = head.load(std::memory_order_relaxed) + 1;
+    head.store(h, std::memory_order_release);
+
+    uint32_t used = h - tail.load(std::memory_order_relaxed);
+    if (used > high_water.load(std::memory_order_relaxed)) {
+      high_water.store(used, std::memory_order_relaxed);
+    }
+  }
+
+  // consumer: oldest published slot, or nullptr if the ring is empty
+  T *front()
+  {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots[t & (Capacity - 1)];
+  }
+
+  // consumer: release the slot returned by front
+  void pop()
+  {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  int size() const
+  {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  int capacity() const
+  {
+    return Capacity;
+  }
+
+  // number of items dropped because the ring was full
+  uint64_t overflowCount() const
+  {
+    return overflows.load(std::memory_order_relaxed);
+  }
+
+  // largest number of items ever waiting in the ring
+  int highWater() const
+  {
+    return high_water.load(std::memory_order_relaxed);
+  }
+};
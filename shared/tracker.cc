@@ -20,45 +20,51 @@ int Tracker::ObjectTracker::mergeObservations()
   }
 
   if (affinity != -1) {
-    history.push_back(obs[affinity]);
-    if (history.size() > VEL_SAMPLES) {
-      history.pop_front();
-    }
+    history.add(obs[affinity].time, obs[affinity].loc);
   }
   return affinity;
 }
 
 vector2f Tracker::ObjectTracker::fitVelocity()
 {
-  // TODO dedup
-  if (history.size() < VEL_SAMPLES
-      || history[0].time - history[history.size() - 1].time > 2 * VEL_SAMPLES * Constants::FramePeriod) {
+  if (!history.full() || history[0].t - history[-VEL_SAMPLES + 1].t > 2 * VEL_SAMPLES * Constants::FramePeriod) {
     return vector2f(0, 0);
   }
+  return history.velocity();
+}
 
-  int samples = VEL_SAMPLES;
-  double t0 = history[0].time;
-  double sxx = 0, sxy = 0, sx = 0, sy = 0;
-  double txx = 0, txy = 0, tx = 0, ty = 0;
-  for (const auto &h : history) {
-    double t = h.time - t0;
-    double x = h.loc.x;
-    double y = h.loc.y;
-
-    sxx += t * t;
-    sxy += t * x;
-    sx += t;
-    sy += x;
-
-    txx += t * t;
-    txy += t * y;
-    tx += t;
-    ty += y;
+void Tracker::updateCameras(int camera, double time)
+{
+  if (!camera_active[camera]) {
+    camera_active[camera] = true;
+    num_cameras++;
+    camera_joins++;
+  }
+  else if (discovering && cameras_seen[camera]) {
+    // every camera that is sending has had its turn, so the next round is
+    // the first complete one
+    discovering = false;
+    for (bool &s : cameras_seen) {
+      s = false;
+    }
+    num_cameras_seen = 0;
+  }
+  if (discovering) {
+    cameras_seen[camera] = true;
   }
-  double vx = (samples * sxy - sx * sy) / (samples * sxx - sx * sx);
-  double vy = (samples * txy - tx * ty) / (samples * txx - tx * tx);
+  camera_last_time[camera] = time;
 
-  return vector2f(vx, vy);
+  for (int c = 0; c < MaxCameras; c++) {
+    if (camera_active[c] && time - camera_last_time[c] > camera_timeout) {
+      camera_active[c] = false;
+      num_cameras--;
+      camera_drops++;
+      if (cameras_seen[c]) {
+        cameras_seen[c] = false;
+        num_cameras_seen--;
+      }
+    }
+  }
 }
 
 void Tracker::updateVision(const SSL_DetectionFrame &d)
@@ -66,28 +72,15 @@ void Tracker::updateVision(const SSL_DetectionFrame &d)
   static const bool debug = false;
 
   int camera = d.camera_id();
-
-  // count how many cameras are sending, at first
-  if (num_cameras <= 0) {
-    if (!cameras_seen[camera]) {
-      num_cameras_seen++;
-      cameras_seen[camera] = true;
-    }
-
-    if (frames++ >= 100) {
-      num_cameras = num_cameras_seen;
-
-      for (bool &s : cameras_seen) {
-        s = false;
-      }
-      num_cameras_seen = 0;
-    }
-    else {
-      return;
-    }
+  if (camera < 0 || camera >= MaxCameras) {
+    return;
   }
 
   double time = d.t_capture();
+  updateCameras(camera, time);
+  if (discovering) {
+    return;
+  }
   last_capture_time = time;
 
   // static uint64_t times[4] = {0};
@@ -153,6 +146,24 @@ void Tracker::updateVision(const SSL_DetectionFrame &d)
       }
     }
 
+    // the filter takes the detection that best fits its prediction, from
+    // every camera; while it has no track, it starts from the one above
+    if (ball_filter.isValid(time)) {
+      double best = HUGE_VAL;
+      const SSL_DetectionBall *best_ball = nullptr;
+      for (const auto &b : d.balls()) {
+        double g = ball_filter.gateDistance(time, vector2f(b.x(), b.y()), b.confidence());
+        if (g < best) {
+          best = g;
+          best_ball = &b;
+        }
+      }
+      ball_filter.update(time, vector2f(best_ball->x(), best_ball->y()), best_ball->confidence());
+    }
+    else if (found) {
+      ball_filter.update(time, vector2f(closest.x(), closest.y()), closest.confidence());
+    }
+
     if (found) {
       Observation &obs = ball.obs[camera];
       obs.valid = true;
@@ -167,18 +178,32 @@ void Tracker::updateVision(const SSL_DetectionFrame &d)
     }
   }
 
+  if (partial_updates) {
+    // the cameras are not synchronized, so a frame may have been captured
+    // before the world last published; its observations are kept for the
+    // next world, so that world times only increase
+    if (ready && time <= world.time) {
+      return;
+    }
+    ready = true;
+    makePartialWorld();
+    new_world = true;
+    return;
+  }
+
   if (!cameras_seen[camera]) {
     num_cameras_seen++;
     cameras_seen[camera] = true;
   }
 
-  ready = (num_cameras_seen == num_cameras);
+  ready = (num_cameras_seen >= num_cameras);
   if (ready) {
     if (debug) {
       puts("\nready\n");
     }
     // condense all observations and convert to World object
     makeWorld();
+    new_world = true;
 
     // forget all previous observations
     for (auto &team_robots : robots) {
@@ -230,7 +255,8 @@ void Tracker::makeWorld()
         wr.angle = obs.angle;
         wr.robot_id.set(static_cast<Team>(team), id);
         wr.vel = robot.fitVelocity();
-        world.robots.push_back(wr);
+        wr.age = world.time - obs.time;
+        world.robots.insert(wr);
 
         if (debug) {
           printf("[%c %x %d <%.0f,%.0f> <%.0f,%.0f>] ", "by"[team], id, robot.affinity, V2COMP(wr.loc), V2COMP(wr.vel));
@@ -243,8 +269,18 @@ void Tracker::makeWorld()
     const Observation &obs = ball.obs[ball.affinity];
     WorldBall &wb = world.ball;
     wb.conf = (1 || obs.last_valid < 2) * obs.conf;
-    wb.loc = obs.loc;
-    wb.vel = ball.fitVelocity();
+    if (ball_filter.isValid(world.time)) {
+      wb.loc = ball_filter.loc(world.time);
+      wb.vel = ball_filter.vel(world.time);
+      wb.loc_var = ball_filter.locVar();
+      wb.vel_var = ball_filter.velVar();
+      wb.age = world.time - ball_filter.time();
+    }
+    else {
+      wb.loc = obs.loc;
+      wb.vel = ball.fitVelocity();
+      wb.age = world.time - obs.time;
+    }
 
     if (debug) {
       printf("[ball %d <%.0f,%.0f> <%.0f,%.0f>] ", ball.affinity, V2COMP(wb.loc), V2COMP(wb.vel));
@@ -254,3 +290,78 @@ void Tracker::makeWorld()
     puts("");
   }
 }
+
+// partial update mode: pick, for each object, the camera to follow among
+// those that have seen it recently, preferring the one followed so far
+static int freshestObservation(Tracker::ObjectTracker &object, double now)
+{
+  Tracker::Observation *obs = object.obs;
+  for (int c = 0; c < MaxCameras; c++) {
+    // frames since this camera last saw the object, for the ball search
+    obs[c].last_valid = 1 + static_cast<int>((now - obs[c].time) * Constants::FrameRate);
+  }
+
+  int best = -1;
+  for (int c = 0; c < MaxCameras; c++) {
+    if (obs[c].valid && (best < 0 || obs[c].time > obs[best].time)) {
+      best = c;
+    }
+  }
+  if (best < 0 || now - obs[best].time > Tracker::MaxObservationAge) {
+    return -1;
+  }
+
+  // switching cameras costs a seam in the velocity fit, so keep the
+  // current one while it is at most a frame behind
+  int a = object.affinity;
+  if (a < 0 || !obs[a].valid || obs[best].time - obs[a].time > 1.5 * Constants::FramePeriod) {
+    object.affinity = best;
+  }
+  a = object.affinity;
+
+  if (object.history.size() == 0 || obs[a].time > object.history[0].t) {
+    object.history.add(obs[a].time, obs[a].loc);
+  }
+  return a;
+}
+
+void Tracker::makePartialWorld()
+{
+  world.reset();
+  world.time = last_capture_time;
+
+  for (int team = 0; team < NumTeams; team++) {
+    for (int id = 0; id < MaxRobotIds; id++) {
+      ObjectTracker &robot = robots[team][id];
+      if (freshestObservation(robot, world.time) >= 0) {
+        const Observation &obs = robot.obs[robot.affinity];
+        WorldRobot wr;
+        wr.conf = obs.conf;
+        wr.loc = obs.loc;
+        wr.angle = obs.angle;
+        wr.robot_id.set(static_cast<Team>(team), id);
+        wr.vel = robot.fitVelocity();
+        wr.age = world.time - obs.time;
+        world.robots.insert(wr);
+      }
+    }
+  }
+
+  if (freshestObservation(ball, world.time) >= 0) {
+    const Observation &obs = ball.obs[ball.affinity];
+    WorldBall &wb = world.ball;
+    wb.conf = obs.conf;
+    if (ball_filter.isValid(world.time)) {
+      wb.loc = ball_filter.loc(world.time);
+      wb.vel = ball_filter.vel(world.time);
+      wb.loc_var = ball_filter.locVar();
+      wb.vel_var = ball_filter.velVar();
+      wb.age = world.time - ball_filter.time();
+    }
+    else {
+      wb.loc = obs.loc;
+      wb.vel = ball.fitVelocity();
+      wb.age = world.time - obs.time;
+    }
+  }
+}
@@ -1,8 +1,8 @@
 #pragma once
 
-#include <deque>
-
 #include "constants.h"
+#include "kalman.h"
+#include "linear_fit.h"
 #include "util.h"
 #include "world.h"
 
@@ -31,7 +31,9 @@ public:
 
     int affinity;
     Observation obs[MaxCameras];
-    std::deque<Observation> history;
+
+    // the locations of the last VEL_SAMPLES observations taken
+    LinearFit<VEL_SAMPLES> history;
 
     ObjectTracker() : affinity(-1){};
     int mergeObservations();
@@ -39,17 +41,36 @@ public:
   };
 
 private:
+  // cameras that have sent a frame in the current round; a round is
+  // complete when every active camera has
   bool cameras_seen[MaxCameras];
   int num_cameras, num_cameras_seen;
   double last_capture_time;
 
+  // cameras currently sending, and the capture time of each one's last frame
+  bool camera_active[MaxCameras];
+  double camera_last_time[MaxCameras];
+  double camera_timeout;
+
+  // until some camera sends a second frame, cameras are only counted
+  bool discovering;
+
+  unsigned int camera_joins, camera_drops;
+
+  void updateCameras(int camera, double time);
+
   bool ready;
 
+  // whether world has been rebuilt since it was last taken with popWorld
+  bool new_world;
+
+  // publish a world after every camera frame instead of after every round
+  bool partial_updates;
+
   World world;
 
   void makeWorld();
-
-  unsigned int frames;
+  void makePartialWorld();
 
   // Observation last_ball;
 
@@ -57,16 +78,69 @@ public:
   ObjectTracker robots[NumTeams][MaxRobotIds];
   ObjectTracker ball;
 
-  Tracker() : num_cameras(0), num_cameras_seen(0), last_capture_time(0), ready(false), frames(0)
+  // ball position and velocity, fused from every camera's detections
+  BallFilter ball_filter;
+
+  // in partial update mode, objects not seen by any camera for this long
+  // (s) are left out of the world
+  static constexpr double MaxObservationAge = .1;
+
+  // a camera that has not sent a frame for this long (s), while others have,
+  // is dropped from the rounds until it sends again
+  static constexpr double DefaultCameraTimeout = .5;
+
+  Tracker()
+      : num_cameras(0),
+        num_cameras_seen(0),
+        last_capture_time(0),
+        camera_timeout(DefaultCameraTimeout),
+        discovering(true),
+        camera_joins(0),
+        camera_drops(0),
+        ready(false),
+        new_world(false),
+        partial_updates(false)
   {
-    for (bool &s : cameras_seen) {
-      s = false;
+    for (int c = 0; c < MaxCameras; c++) {
+      cameras_seen[c] = false;
+      camera_active[c] = false;
+      camera_last_time[c] = 0;
     }
   }
 
   // returns whether a new referee message is available
   void updateVision(const SSL_DetectionFrame &d);
 
+  // Instead of waiting until every camera has sent a frame, rebuild the world
+  // after each camera frame from the freshest observation of each object
+  // (see WorldRobot::age). This cuts the latency to that of the newest frame.
+  // A frame captured before the last world was published adds its
+  // observations without publishing a world, so world times still increase.
+  void setPartialUpdates(bool partial)
+  {
+    partial_updates = partial;
+  }
+
+  void setCameraTimeout(double timeout)
+  {
+    camera_timeout = timeout;
+  }
+
+  // number of cameras currently taking part in the rounds, and how many
+  // times one has joined (including at startup) or been dropped
+  int numCameras() const
+  {
+    return num_cameras;
+  }
+  unsigned int cameraJoins() const
+  {
+    return camera_joins;
+  }
+  unsigned int cameraDrops() const
+  {
+    return camera_drops;
+  }
+
   bool isReady()
   {
     return ready;
@@ -78,4 +152,16 @@ public:
     }
     return ready;
   }
+
+  // like getWorld, but returns each rebuilt world only once, even if frames
+  // from the next round have arrived since it was built
+  bool popWorld(World &w)
+  {
+    if (new_world) {
+      w = world;
+      new_world = false;
+      return true;
+    }
+    return false;
+  }
 };
@@ -1,5 +1,7 @@
 #include "udp.h"
 
+#include <time.h>
+
 //====================================================================//
 //  Net::Address: Network address class
 //====================================================================//
@@ -85,6 +87,15 @@ bool UDP::open(const char *server_host, int port, bool blocking)
     }
   }
 
+  {
+    // have the kernel stamp each datagram with its arrival time
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) {
+      fprintf(stderr, "ERROR WHEN SETTING SO_TIMESTAMPNS ON UDP SOCKET\n");
+      fflush(stderr);
+    }
+  }
+
   socklen_t len = 0;
   int yes = 1;
   getsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<char *>(&yes), &len);
@@ -158,7 +169,7 @@ bool UDP::send(const void *data, int length, const Address &dest)
 
 bool UDP::send(const Message &packet, const Address &dest)
 {
-  string s = packet.SerializeAsString();
+  std::string s = packet.SerializeAsString();
   return send(s.data(), s.size(), dest);
 }
 
@@ -190,6 +201,64 @@ bool UDP::recv(Message &packet)
   return recv(packet, addr);
 }
 
+int UDP::recvBatch(Datagram *out, int max)
+{
+  if (max > MaxRecvBatch) {
+    max = MaxRecvBatch;
+  }
+  if (batch_buf.empty()) {
+    batch_buf.resize(static_cast<size_t>(MaxRecvBatch) * MaxDataGramSize);
+  }
+
+  mmsghdr msgs[MaxRecvBatch];
+  iovec iovs[MaxRecvBatch];
+  char ctrl[MaxRecvBatch][CMSG_SPACE(sizeof(timespec))];
+
+  memset(msgs, 0, sizeof(msgs[0]) * max);
+  for (int i = 0; i < max; i++) {
+    iovs[i].iov_base = &batch_buf[static_cast<size_t>(i) * MaxDataGramSize];
+    iovs[i].iov_len = MaxDataGramSize;
+
+    out[i].src.addr_len = sizeof(out[i].src.addr);
+    msgs[i].msg_hdr.msg_name = &out[i].src.addr;
+    msgs[i].msg_hdr.msg_namelen = out[i].src.addr_len;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_control = ctrl[i];
+    msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+  }
+
+  int n = recvmmsg(fd, msgs, max, MSG_DONTWAIT, nullptr);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  for (int i = 0; i < n; i++) {
+    Datagram &d = out[i];
+    d.data = static_cast<const char *>(iovs[i].iov_base);
+    d.len = msgs[i].msg_len;
+    d.src.addr_len = msgs[i].msg_hdr.msg_namelen;
+
+    // fall back to the time of the syscall if the kernel gave no timestamp
+    timespec ts = now;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c != nullptr; c = CMSG_NXTHDR(&msgs[i].msg_hdr, c)) {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        break;
+      }
+    }
+    d.recv_time = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    recv_packets++;
+    recv_bytes += d.len;
+  }
+
+  return n;
+}
+
 bool UDP::havePendingData() const
 {
   return wait(0);
@@ -198,7 +267,6 @@ bool UDP::havePendingData() const
 bool UDP::wait(int timeout_ms) const
 {
   static const bool debug = false;
-  static bool pendingData = false;
   pollfd pfd;
   pfd.fd = fd;
   pfd.events = POLLIN;
@@ -210,9 +278,9 @@ bool UDP::wait(int timeout_ms) const
     // Poll now claims that there is no pending data.
     // What did havePendingData get from Poll most recently?
     if (debug) {
-      printf("wait failed, havePendingData=%s\n", (pendingData ? "true" : "false"));
+      printf("wait failed, havePendingData=%s\n", (pending_data ? "true" : "false"));
     }
   }
-  pendingData = success;
+  pending_data = success;
   return success;
 }
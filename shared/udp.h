@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <stdio.h>
 #include <string.h>
@@ -20,6 +21,9 @@ using namespace google::protobuf;
 
 static const int MaxDataGramSize = 65536;
 
+// maximum number of datagrams drained by a single UDP::recvBatch call
+static const int MaxRecvBatch = 16;
+
 static const int PORT_OFFSET =
 #include "PORT_OFFSET"
   ;
@@ -98,11 +102,32 @@ public:
   friend class UDP;
 };
 
+// one datagram returned by UDP::recvBatch; data points into the socket's
+// batch buffer and stays valid until the next recvBatch call
+struct Datagram
+{
+  const char *data;
+  int len;
+  Address src;
+
+  // kernel arrival time (SO_TIMESTAMPNS, CLOCK_REALTIME) in seconds
+  double recv_time;
+
+  Datagram() : data(nullptr), len(0), recv_time(0)
+  {
+  }
+};
+
 class UDP
 {
   char buf[MaxDataGramSize];
   int fd;
 
+  std::vector<char> batch_buf;
+
+  // result of the last wait (for debugging)
+  mutable bool pending_data;
+
 public:
   unsigned sent_packets;
   unsigned sent_bytes;
@@ -113,6 +138,7 @@ public:
   UDP()
   {
     fd = -1;
+    pending_data = false;
     close();
   }
   ~UDP()
@@ -135,6 +161,10 @@ public:
   bool recv(Message &packet);
   bool recv(Message &packet, Address &src);
 
+  // receive every pending datagram (up to max) with one recvmmsg call,
+  // without blocking; returns the number received, or -1 on error
+  int recvBatch(Datagram *out, int max = MaxRecvBatch);
+
   bool wait(int timeout_ms = -1) const;
   bool havePendingData() const;
 
@@ -1,6 +1,7 @@
 #include <cstdarg>
 #include <random>
 
+#include "field_model.h"
 #include "geomalgo.h"
 #include "util.h"
 
@@ -30,6 +31,8 @@ SSL_Referee::Command teamCommand(TeamCommand cmd, Team team)
   }
 
 #undef X
+
+  return SSL_Referee::HALT;
 }
 
 Team commandTeam(SSL_Referee::Command command)
@@ -59,6 +62,7 @@ Team commandTeam(SSL_Referee::Command command)
     case SSL_Referee::HALT:
       return TeamNone;
   }
+  return TeamNone;
 }
 
 std::string commandDisplayName(SSL_Referee::Command command)
@@ -103,6 +107,7 @@ std::string commandDisplayName(SSL_Referee::Command command)
     case SSL_Referee::HALT:
       return "HALT";
   }
+  return "UNKNOWN";
 }
 
 std::string stageDisplayName(SSL_Referee::Stage stage)
@@ -147,100 +152,22 @@ std::string StringFormat(const char *format, va_list al)
 
 vector2f OutOfBoundsLoc(const vector2f &objectLoc, const vector2f &objectDir)
 {
-  int signx = sign(objectDir.x);
-  int signy = sign(objectDir.y);
-  if (objectDir.x == 0 && objectDir.y == 0) {
-    return objectLoc;
-  }
-  if (objectDir.x == 0) {
-    return (signy == 1) ? vector2f(objectLoc.x, Constants::FieldWidthH)
-                        : vector2f(objectLoc.x, -Constants::FieldWidthH);
-  }
-  if (objectDir.y == 0) {
-    return (signx == 1) ? vector2f(Constants::FieldLengthH, objectLoc.y)
-                        : vector2f(-Constants::FieldLengthH, objectLoc.y);
-  }
-
-  vector2f dir = objectDir.norm();
-  double xtime, ytime;
-  if ((signx == 1) && (signy == 1)) {
-    double theirSideDist = Constants::FieldLengthH - objectLoc.x;
-    double leftSideDist = Constants::FieldWidthH - objectLoc.y;
-    xtime = theirSideDist / dir.x;
-    ytime = leftSideDist / dir.y;
-    return (xtime < ytime) ? vector2f(Constants::FieldLengthH, objectLoc.y + xtime * dir.y)
-                           : vector2f(objectLoc.x + ytime * dir.x, Constants::FieldWidthH);
-  }
-  if ((signx == 1) && (signy == -1)) {
-    double theirSideDist = Constants::FieldLengthH - objectLoc.x;
-    double rightSideDist = fabs(-Constants::FieldWidthH - objectLoc.y);
-    xtime = fabs(theirSideDist / dir.x);
-    ytime = fabs(rightSideDist / dir.y);
-    return (xtime < ytime) ? vector2f(Constants::FieldLengthH, objectLoc.y + xtime * dir.y)
-                           : vector2f(objectLoc.x + ytime * dir.x, -Constants::FieldWidthH);
-  }
-  if ((signx == -1) && (signy == 1)) {
-    double ourSideDist = fabs(-Constants::FieldLengthH - objectLoc.x);
-    double rightSideDist = Constants::FieldWidthH - objectLoc.y;
-    xtime = fabs(ourSideDist / dir.x);
-    ytime = fabs(rightSideDist / dir.y);
-    return (xtime < ytime) ? vector2f(-Constants::FieldLengthH, objectLoc.y + xtime * dir.y)
-                           : vector2f(objectLoc.x + ytime * dir.x, Constants::FieldWidthH);
-  }
-  double ourSideDist = fabs(-Constants::FieldLengthH - objectLoc.x);
-  double leftSideDist = fabs(-Constants::FieldWidthH - objectLoc.y);
-  xtime = fabs(ourSideDist / dir.x);
-  ytime = fabs(leftSideDist / dir.y);
-  return (xtime < ytime) ? vector2f(-Constants::FieldLengthH, objectLoc.y + xtime * dir.y)
-                         : vector2f(objectLoc.x + ytime * dir.x, -Constants::FieldWidthH);
+  return FieldModel::get().outOfBoundsLoc(objectLoc, objectDir);
 }
 
 vector2f ClosestDefenseAreaP(const vector2f &loc, bool positive_x, double dist)
 {
-  auto sgn = positive_x ? 1 : -1;
-  auto x = sgn * loc.x, y = std::abs(loc.y);
-
-  vector2f ret = loc;
-
-  if (x > Constants::FieldLengthH - Constants::DefenseLength
-      && x + y > Constants::FieldLengthH - Constants::DefenseLength + Constants::DefenseWidthH) {
-    ret.set(x, Constants::DefenseWidthH + dist);
-  }
-  else if (y < Constants::DefenseWidthH
-           && x + y <= Constants::FieldLengthH - Constants::DefenseLength + Constants::DefenseWidthH) {
-    ret.set(Constants::FieldLengthH - Constants::DefenseLength - dist, y);
-  }
-  else {
-    vector2f corner(Constants::FieldLengthH - Constants::DefenseLength, Constants::DefenseWidthH);
-    ret.set(corner + (loc - corner).norm(dist));
-  }
-
-  if (loc.y < 0) {
-    ret.y *= -1;
-  }
-  return ret * sgn;
+  return FieldModel::get().closestDefenseAreaP(loc, positive_x, dist);
 }
 
 bool IsInField(vector2f loc, float margin, bool avoid_defense)
 {
-  auto x = std::abs(loc.x), y = std::abs(loc.y);
-
-  // check outside field boundaries
-  if (x > Constants::FieldLengthH - margin) {
-    return false;
-  }
-  if (y > Constants::FieldWidthH - margin) {
-    return false;
-  }
-
-  // check defense area
-  if (avoid_defense) {
-    if (x > Constants::FieldLengthH - Constants::DefenseLength - margin && y < Constants::DefenseWidthH + margin) {
-      return false;
-    }
-  }
+  return FieldModel::get().inField(loc, margin, avoid_defense);
+}
 
-  return true;
+bool IsInGoal(vector2f loc)
+{
+  return FieldModel::get().inGoal(loc);
 }
 
 vector2f BoundToField(vector2f loc, float margin, bool avoid_defense)
@@ -273,9 +200,18 @@ uint64_t GetTimeMicros()
   return tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
 }
 
+uint64_t HashBytes(const void *data, size_t len, uint64_t h)
+{
+  const auto *p = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ p[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
 Team RandomTeam()
 {
-  static std::default_random_engine generator(std::random_device{}());
-  static std::uniform_int_distribution<unsigned int> binary_dist(0, 1);
+  static thread_local std::default_random_engine generator(std::random_device{}());
+  static thread_local std::uniform_int_distribution<unsigned int> binary_dist(0, 1);
   return binary_dist(generator) ? TeamYellow : TeamBlue;
 }
@@ -36,7 +36,7 @@ struct tvec
   {
   }
 
-  bool between(tvec start, tvec end)
+  bool between(tvec start, tvec end) const
   {
     double c = (t - start.t) / (end.t - start.t);
     vector2f v0 = (1 - c) * start.v + c * end.v;
@@ -92,16 +92,24 @@ const char *TeamName(Team team, bool capital = false);
 
 std::string StringFormat(const char *format, va_list al);
 
+// the FieldModel queries of the same names, on this thread's model
 vector2f OutOfBoundsLoc(const vector2f &objectLoc, const vector2f &objectDir);
 
 vector2f ClosestDefenseAreaP(const vector2f &loc, bool ours, double dist);
 
 bool IsInField(vector2f loc, float margin, bool avoid_defense);
 
+// whether loc is inside either goal, behind the goal line
+bool IsInGoal(vector2f loc);
+
 vector2f BoundToField(vector2f loc, float margin, bool avoid_defense);
 
 Team FlipTeam(Team team);
 
 uint64_t GetTimeMicros();
 
+// 64-bit FNV-1a over a byte range, continuing from h
+static const uint64_t HashSeed = 14695981039346656037ULL;
+uint64_t HashBytes(const void *data, size_t len, uint64_t h = HashSeed);
+
 Team RandomTeam();
@@ -0,0 +1,106 @@
+#include "work_pool.h"
+
+// attempts to find a task before an idle worker goes to sleep
+static const int SpinRounds = 2000;
+
+WorkPool::WorkPool(int threads) : next_queue(0), queued(0), sleeping(0), stopping(false)
+{
+  for (int i = 0; i < threads; i++) {
+    queues.emplace_back(new Queue);
+  }
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(&WorkPool::work, this, i);
+  }
+}
+
+WorkPool::~WorkPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &t : workers) {
+    t.join();
+  }
+}
+
+void WorkPool::submit(Task task)
+{
+  if (queues.empty()) {
+    task();
+    return;
+  }
+
+  Queue &q = *queues[next_queue++ % queues.size()];
+  {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.push_back(std::move(task));
+  }
+  queued.fetch_add(1, std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(sleep_mutex);
+  if (sleeping > 0) {
+    wake.notify_one();
+  }
+}
+
+bool WorkPool::take(int first, Task &task)
+{
+  if (queued.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+
+  int n = queues.size();
+  for (int k = 0; k < n; k++) {
+    Queue &q = *queues[(first + k) % n];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+      continue;
+    }
+    if (k == 0) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    }
+    else {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool WorkPool::runOne()
+{
+  Task task;
+  if (!take(0, task)) {
+    return false;
+  }
+  task();
+  return true;
+}
+
+void WorkPool::work(int index)
+{
+  Task task;
+  while (true) {
+    bool found = false;
+    for (int i = 0; i < SpinRounds && !found; i++) {
+      found = take(index, task);
+    }
+    if (found) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleeping++;
+    wake.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+    sleeping--;
+    if (stopping && queued.load(std::memory_order_acquire) == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A few worker threads for running small tasks, e.g. a frame's worth of
+// rules. Each worker has its own queue, which submit() fills round-robin; a
+// worker takes the newest task from its own queue and, when that is empty,
+// steals the oldest from another's. The submitting thread can take tasks as
+// well while it waits for them (runOne), so no task is stuck behind a busy
+// worker. Idle workers spin for a little while before sleeping, since tasks
+// tend to come in bursts once per frame.
+class WorkPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  explicit WorkPool(int threads);
+  ~WorkPool();
+
+  int size() const
+  {
+    return workers.size();
+  }
+
+  void submit(Task task);
+
+  // runs one queued task on the calling thread; returns false if there was
+  // none to take
+  bool runOne();
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  unsigned int next_queue;
+
+  // tasks submitted and not yet taken
+  std::atomic<int> queued;
+
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  int sleeping;
+  bool stopping;
+
+  // takes a task from queue first (newest first) or else from the others
+  // (oldest first)
+  bool take(int first, Task &task);
+  void work(int index);
+};
@@ -1,7 +1,8 @@
 #pragma once
 
+#include <cmath>
 #include <cstdint>
-#include <vector>
+#include <type_traits>
 
 #include "constants.h"
 #include "gvector.h"
@@ -15,12 +16,16 @@ struct WorldRobot
   float angle;
   vector2f loc, vel;
 
+  // seconds between the capture of the observation this came from and the
+  // world's time (nonzero mostly with partial updates)
+  float age;
+
   bool visible() const
   {
     return conf > .1;
   }
 
-  WorldRobot() : conf(0), angle(0), loc(0, 0), vel(0, 0)
+  WorldRobot() : conf(0), angle(0), loc(0, 0), vel(0, 0), age(0)
   {
   }
 };
@@ -30,27 +35,153 @@ struct WorldBall
   float conf;
 
   vector2f loc, vel;
+
+  // per-axis variances of loc and vel from the ball filter (mm^2,
+  // (mm/s)^2); large right after the ball is (re)acquired. Negative if the
+  // estimate did not come from the filter.
+  float loc_var, vel_var;
+
+  // as WorldRobot::age
+  float age;
+
   bool visible() const
   {
     return conf > .1;
   }
 
-  WorldBall() : loc(0, 0), vel(0, 0), conf(0)
+  // standard deviation of the speed estimate (along any direction)
+  float speedSigma() const
+  {
+    return vel_var >= 0 ? sqrtf(vel_var) : HUGE_VALF;
+  }
+
+  WorldBall() : conf(0), loc(0, 0), vel(0, 0), loc_var(-1), vel_var(-1), age(0)
   {
   }
 };
 
+// The robots in a World: one slot per (team, id) and a bitmask of the
+// occupied ones, so that copying a World is a single fixed-size memcpy and
+// looking up a robot is O(1). Iteration visits the occupied slots in (team,
+// id) order.
+class RobotSet
+{
+public:
+  static const int NumSlots = NumTeams * MaxRobotIds;
+
+  class const_iterator
+  {
+    const WorldRobot *slots;
+    uint64_t rest;
+
+  public:
+    const_iterator(const WorldRobot *slots_, uint64_t rest_) : slots(slots_), rest(rest_)
+    {
+    }
+
+    const WorldRobot &operator*() const
+    {
+      return slots[__builtin_ctzll(rest)];
+    }
+    const WorldRobot *operator->() const
+    {
+      return &**this;
+    }
+    const_iterator &operator++()
+    {
+      rest &= rest - 1;
+      return *this;
+    }
+    bool operator!=(const const_iterator &other) const
+    {
+      return rest != other.rest;
+    }
+    bool operator==(const const_iterator &other) const
+    {
+      return rest == other.rest;
+    }
+  };
+
+  RobotSet() : active(0)
+  {
+  }
+
+  void clear()
+  {
+    active = 0;
+  }
+
+  // adds r in the slot for r.robot_id (which must be valid), replacing any
+  // robot already there
+  void insert(const WorldRobot &r)
+  {
+    int s = slot(r.robot_id);
+    slots[s] = r;
+    active |= uint64_t(1) << s;
+  }
+
+  // the robot with the given id, or nullptr if it is not in the set
+  const WorldRobot *find(RobotID id) const
+  {
+    if (!id.isValid()) {
+      return nullptr;
+    }
+    int s = slot(id);
+    return (active >> s & 1) ? &slots[s] : nullptr;
+  }
+
+  bool empty() const
+  {
+    return active == 0;
+  }
+  int size() const
+  {
+    return __builtin_popcountll(active);
+  }
+
+  const_iterator begin() const
+  {
+    return const_iterator(slots, active);
+  }
+  const_iterator end() const
+  {
+    return const_iterator(slots, 0);
+  }
+
+  // index of the slot for a valid id
+  static int slot(RobotID id)
+  {
+    return id.team * MaxRobotIds + id.id;
+  }
+
+private:
+  uint64_t active;
+  WorldRobot slots[NumSlots];
+
+  static_assert(NumSlots <= 64, "the slot bitmask is a uint64_t");
+};
+
 struct World
 {
   double time;
 
-  std::vector<WorldRobot> robots;
+  RobotSet robots;
   WorldBall ball;
 
+  // the robot with the given id, or nullptr if it is not visible
+  const WorldRobot *robot(RobotID id) const
+  {
+    return robots.find(id);
+  }
+
   void reset()
   {
     time = 0;
     robots.clear();
     ball.conf = 0;
+    ball.loc_var = ball.vel_var = -1;
+    ball.age = 0;
   }
 };
+
+static_assert(std::is_trivially_copyable<World>::value, "World is copied as a plain block of memory");
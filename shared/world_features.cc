@@ -0,0 +1,68 @@
+#include "world_features.h"
+
+#include "geomalgo.h"
+#include "util.h"
+
+float WorldFeatures::ballDist(const WorldRobot &r) const
+{
+  int s = RobotSet::slot(r.robot_id);
+  uint64_t bit = uint64_t(1) << s;
+  if (!(have_ball_dist & bit)) {
+    geometry.ball_dist[s] = (r.loc - world->ball.loc).length();
+    have_ball_dist |= bit;
+  }
+  return geometry.ball_dist[s];
+}
+
+vector2f WorldFeatures::ballLocal(const WorldRobot &r) const
+{
+  int s = RobotSet::slot(r.robot_id);
+  uint64_t bit = uint64_t(1) << s;
+  if (!(have_ball_local & bit)) {
+    vector2f local = (world->ball.loc - r.loc).rotate(-r.angle);
+    geometry.ball_local_x[s] = local.x;
+    geometry.ball_local_y[s] = local.y;
+    have_ball_local |= bit;
+  }
+  return vector2f(geometry.ball_local_x[s], geometry.ball_local_y[s]);
+}
+
+double WorldFeatures::defenseDist(const WorldRobot &r, bool positive_x) const
+{
+  int s = RobotSet::slot(r.robot_id);
+  uint64_t bit = uint64_t(1) << s;
+  if (!(have_defense_dist[positive_x] & bit)) {
+    geometry.defense_dist[positive_x][s] = DistToDefenseArea(r.loc, positive_x);
+    have_defense_dist[positive_x] |= bit;
+  }
+  return geometry.defense_dist[positive_x][s];
+}
+
+bool WorldFeatures::ballInField() const
+{
+  if (ball_in_field == Unknown) {
+    ball_in_field = IsInField(world->ball.loc, -Constants::BallRadius, false) ? Yes : No;
+  }
+  return ball_in_field == Yes;
+}
+
+bool WorldFeatures::ballInGoal() const
+{
+  if (ball_in_goal == Unknown) {
+    ball_in_goal = IsInGoal(world->ball.loc) ? Yes : No;
+  }
+  return ball_in_goal == Yes;
+}
+
+void WorldFeatures::computeAll()
+{
+  if (world == nullptr) {
+    return;
+  }
+  arrays.load(world->robots);
+  ComputeRobotGeometry(arrays, world->ball.loc, geometry);
+  have_ball_dist = have_ball_local = arrays.active;
+  have_defense_dist[0] = have_defense_dist[1] = arrays.active;
+  ballInField();
+  ballInGoal();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+#include "robot_geometry.h"
+#include "world.h"
+
+// Geometry derived from one World that several events need. Each quantity is
+// computed on first use and then kept until the next frame, so the events
+// share the work instead of each redoing it; reset() itself is O(1). Robot
+// quantities are stored by RobotSet slot, and the robot passed in must be
+// one of the world's.
+class WorldFeatures
+{
+public:
+  WorldFeatures() : world(nullptr)
+  {
+    reset(nullptr);
+  }
+
+  // start a new frame; w must stay alive and unchanged until the next reset
+  void reset(const World *w)
+  {
+    world = w;
+    have_ball_dist = have_ball_local = 0;
+    have_defense_dist[0] = have_defense_dist[1] = 0;
+    ball_in_field = ball_in_goal = Unknown;
+  }
+
+  // distance from the robot's center to the ball's
+  float ballDist(const WorldRobot &r) const;
+
+  // the ball's position relative to the robot, with x along its heading
+  vector2f ballLocal(const WorldRobot &r) const;
+
+  // DistToDefenseArea of the robot, for the area on the given side
+  double defenseDist(const WorldRobot &r, bool positive_x) const;
+
+  // whether the ball is at least partly over the field (within a ball radius
+  // of the boundary lines), or inside a goal
+  bool ballInField() const;
+  bool ballInGoal() const;
+
+  // computes everything for the current world at once, the robot geometry
+  // for all robots in one ComputeRobotGeometry pass; after that the
+  // accessors only read, so several threads can use them together
+  void computeAll();
+
+private:
+  enum Tristate : int8_t
+  {
+    Unknown = -1,
+    No = 0,
+    Yes = 1,
+  };
+
+  const World *world;
+
+  // bit s set if the value for RobotSet slot s has been computed this frame
+  mutable uint64_t have_ball_dist, have_ball_local, have_defense_dist[2];
+
+  RobotArrays arrays;
+  mutable RobotGeometry geometry;
+  mutable Tristate ball_in_field, ball_in_goal;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "world.h"
+
+// The most recent worlds passed to the events, written once per frame and
+// read in place, so that the events and touch processors can all look back
+// over the same frames without keeping histories of their own. Indexed like
+// RunningQueue: 0 is the newest world and -k the one k frames before it.
+class WorldHistory
+{
+public:
+  // enough for the longest look-back (about half a second), even with a
+  // world per camera frame from MaxCameras cameras at 60 Hz
+  static const int Size = 256;
+  static_assert(Size >= MaxCameras * 60 / 2, "WorldHistory must hold half a second of camera frames");
+
+  WorldHistory() : newest(Size - 1), num(0)
+  {
+  }
+
+  void add(const World &w)
+  {
+    newest = (newest + 1) % Size;
+    worlds[newest] = w;
+    if (num < Size) {
+      num++;
+    }
+  }
+
+  void clear()
+  {
+    newest = Size - 1;
+    num = 0;
+  }
+
+  bool empty() const
+  {
+    return num == 0;
+  }
+  int size() const
+  {
+    return num;
+  }
+  bool isValidIdx(int i) const
+  {
+    return i > -num && i <= 0;
+  }
+
+  const World &operator[](int i) const
+  {
+    return worlds[(newest + i + Size) % Size];
+  }
+
+  double time(int i) const
+  {
+    return (*this)[i].time;
+  }
+  const WorldBall &ball(int i) const
+  {
+    return (*this)[i].ball;
+  }
+  // the robot in world i, or nullptr if it was not seen then
+  const WorldRobot *robot(RobotID id, int i) const
+  {
+    return (*this)[i].robot(id);
+  }
+
+private:
+  World worlds[Size];
+  int newest, num;
+};
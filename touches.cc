@@ -1,252 +1,331 @@
 #include "touches.h"
 
-bool AccelProcessor::proc(const World &w, CollideResult &res)
+// whether the line through a and b passes within r of the origin
+static bool lineNearOrigin(vector2f a, vector2f b, float r)
 {
-  history.add(w);
-
-  if (w.ball.conf < .1) {
-    return false;
-  }
-
-  if (history.size() < 3) {
-    return false;
-  }
-
-  vector2f delta = history[-1].ball.loc - (history[0].ball.loc + history[-2].ball.loc) / 2;
-  double accel = delta.length() * Constants::FrameRate * Constants::FrameRate;
-
-  if (accel < 2000) {
-    return false;
-  }
-
-  vector2f ball_pt = history[-1].ball.loc;
-  double closest_dist = HUGE_VALF;
-  WorldRobot closest_robot;
-  for (const auto &r : w.robots) {
-    if (dist(r.loc, ball_pt) < closest_dist) {
-      closest_dist = dist(r.loc, ball_pt);
-      closest_robot = r;
-    }
-  }
+  vector2f d = b - a;
+  float c = d.cross(a);
+  return c * c < r * r * d.sqlength();
+}
 
-  bool near = closest_dist < Constants::MaxRobotRadius + Constants::BallRadius + 10;
-  if (!near) {
-    return false;
+void TouchEngine::reset()
+{
+  for (Track &track : tracks) {
+    track.newest = Track::Size - 1;
+    track.num = 0;
+    track.ball_visible = 0;
+    track.fit.clear();
   }
-
-  res.robot_id = closest_robot.robot_id;
-  res.time = history[-1].time;
-
-  return true;
+  frame_time = -HUGE_VAL;
+  frame_touched = false;
+  since_touch = RefractoryFrames + 1;
 }
 
-bool LineCheckProcessor::proc(const World &w, CollideResult &res)
+bool TouchEngine::update(const WorldHistory &history, Touch &touch)
 {
-  last++;
-  history.add(w);
+  const World &w = history[0];
+  double t = w.time;
 
-  if (w.ball.conf < .1) {
-    return false;
+  if (t == frame_time) {
+    touch = frame_touch;
+    return frame_touched;
   }
-
-  if (history.size() < 6) {
-    return false;
+  if (t < frame_time) {
+    // a new log (or a new match); the samples from before are not history
+    reset();
   }
+  frame_time = t;
+  frame_touched = false;
+  since_touch++;
 
-  // check whether first three and last three make good different fits
-  if (!(line3(history[-5], history[-4], history[-3]) && line3(history[-2], history[-1], history[0])
-        && !line3(history[-5], history[-3], history[0]))) {
-    return false;
+  const WorldBall &ball = w.ball;
+  bool ball_seen = ball.conf >= .1;
+
+  Limits limits;
+  limits.frame_period = Constants::FramePeriod;
+  limits.backtrack_radius = Constants::MaxRobotRadius + Constants::BallRadius - 10;
+  limits.through_radius = Constants::MaxRobotRadius - Constants::BallRadius;
+  limits.robot_dist_radius = Constants::MaxRobotRadius + Constants::BallRadius + 30;
+
+  // Accel: an abrupt change in the ball's velocity at the previous world,
+  // blamed on whichever robot is then nearest to the ball; the worlds need
+  // not be evenly spaced, so the velocities on either side of it are taken
+  // over their own intervals
+  bool accel = false;
+  vector2f accel_pt(0, 0);
+  if (ball_seen && history.size() >= 3) {
+    double dt_before = history[-1].time - history[-2].time, dt_after = history[0].time - history[-1].time;
+    if (dt_before > 0 && dt_after > 0) {
+      vector2f dv = (history[0].ball.loc - history[-1].ball.loc) / dt_after
+                    - (history[-1].ball.loc - history[-2].ball.loc) / dt_before;
+      accel = dv.length() * 2 / (dt_before + dt_after) >= 4000;
+      accel_pt = history[-1].ball.loc;
+    }
   }
+  float accel_radius = Constants::MaxRobotRadius + Constants::BallRadius + 10;
+  float accel_dist = HUGE_VALF;
+  int accel_slot = -1;
+
+  // for each robot slot, the product of (1 - weighted score) over the
+  // methods that saw it touch the ball, and the time given by the method
+  // with the highest weighted score
+  float miss[RobotSet::NumSlots];
+  float strongest[RobotSet::NumSlots];
+  double times[RobotSet::NumSlots];
+  uint32_t methods[RobotSet::NumSlots];
 
-  // look for nearby robot
-  vector2f ball_pt
-    = intersection(history[-5].ball.loc, history[-3].ball.loc, history[-2].ball.loc, history[0].ball.loc);
-
-  double closest_dist = HUGE_VALF;
-  WorldRobot closest_robot;
-  const World &old = history[-3];
+  for (const auto &r : w.robots) {
+    int s = RobotSet::slot(r.robot_id);
+    miss[s] = 1;
+    strongest[s] = 0;
+    times[s] = t;
+    methods[s] = 0;
+
+    if (accel && dist(r.loc, accel_pt) < accel_dist) {
+      accel_dist = dist(r.loc, accel_pt);
+      accel_slot = s;
+    }
 
-  if (old.robots.empty()) {
-    return false;
-  }
+    if (!ball_seen || !r.visible()) {
+      continue;
+    }
+    Track &track = tracks[s];
+    track.add(tvec(t, ball.loc - r.loc), ball.visible());
+
+    // the samples are in time order, so if the oldest one a method needs is
+    // recent enough, they all are
+    double time;
+    SampleView hist = track.recent();
+    float score = 0;
+    if (hist.size() >= BACKTRACK_LEN && t - hist[-BACKTRACK_LEN + 1].t <= 3 * BACKTRACK_LEN * limits.frame_period) {
+      score = scoreBackTrack(track, limits, time) * BackTrackWeight;
+    }
+    if (score > 0) {
+      miss[s] *= 1 - score;
+      strongest[s] = score;
+      times[s] = time;
+      methods[s] |= BACKTRACK;
+    }
 
-  for (const auto &r : old.robots) {
-    if (dist(r.loc, ball_pt) < closest_dist) {
-      closest_dist = dist(r.loc, ball_pt);
-      closest_robot = r;
+    // RobotDist only uses the samples with the ball visible; it almost
+    // always was in all of them, or the ones it needs can be gathered
+    const uint32_t all_visible = (1 << ROBOT_DIST_LEN) - 1;
+    tvec visible[ROBOT_DIST_LEN];
+    if ((track.ball_visible & all_visible) != all_visible) {
+      int n = 0;
+      for (int k = 0; k > -hist.size() && n < ROBOT_DIST_LEN; k--) {
+        if (track.ball_visible >> -k & 1) {
+          visible[ROBOT_DIST_LEN - 1 - n++] = hist[k];
+        }
+      }
+      hist = SampleView(&visible[ROBOT_DIST_LEN - 1], n);
+    }
+    score = 0;
+    if (ball.visible() && hist.size() >= ROBOT_DIST_LEN
+        && t - hist[-ROBOT_DIST_LEN + 1].t <= 15 * limits.frame_period) {
+      score = scoreRobotDist(hist, limits, time) * RobotDistWeight;
+    }
+    if (score > 0) {
+      miss[s] *= 1 - score;
+      if (score > strongest[s]) {
+        strongest[s] = score;
+        times[s] = time;
+      }
+      methods[s] |= ROBOT_DIST;
     }
   }
 
-  res.robot_id = closest_robot.robot_id;
-
-  // make sure robot comes near ball at some point (TODO use interframe locations)
-  bool near = false;
-  near = (closest_dist < Constants::MaxRobotRadius + Constants::BallRadius + 3);
-  // TODO fix this
-  // for (int i = -5; i <= 0; i++) {
-  //   if (dist(history[i].robots[closest_ind].loc, history[i].ball.loc) < Constants::MaxRobotRadius +
-  //   Constants::BallRadius + 30) {
-  //     near = true;
-  //     break;
-  //   }
-  // }
-
-  if (!near || last < 3) {
-    return false;
+  if (accel_slot >= 0 && accel_dist < accel_radius) {
+    float score = (.5 + .5 * (1 - accel_dist / accel_radius)) * AccelWeight;
+    miss[accel_slot] *= 1 - score;
+    if (score > strongest[accel_slot]) {
+      strongest[accel_slot] = score;
+      times[accel_slot] = history[-1].time;
+    }
+    methods[accel_slot] |= ACCEL;
   }
 
-  // TODO something more accurate?
-  res.time = history[-2].time;
-  last = 0;
-  return true;
-}
-
-bool RobotDistProcessor::proc(const World &w, CollideResult &res)
-{
-  last++;
-  double t = w.time;
-  const WorldBall &ball = w.ball;
-
-  if (!ball.visible()) {
+  if (since_touch <= RefractoryFrames) {
     return false;
   }
 
-  bool found = false;
-
+  // the robot with the highest confidence is blamed; on a tie, the one whose
+  // strongest method was the more certain, and then the one nearer the ball
+  int best = -1;
+  float best_dist = 0;
   for (const auto &r : w.robots) {
-    if (!r.visible()) {
+    int s = RobotSet::slot(r.robot_id);
+    float confidence = 1 - miss[s];
+    if (methods[s] == 0 || confidence < MinConfidence) {
       continue;
     }
-    vector2f v = ball.loc - r.loc;
-
-    RunningQueue<tvec, 6> &hist = robot_history[r.robot_id.team][r.robot_id.id];
-    hist.add(tvec(t, v));
-
-    if (hist.size() < 6) {
-      continue;
+    float d = dist(r.loc, ball.loc);
+    if (best >= 0) {
+      float best_confidence = 1 - miss[best];
+      if (confidence != best_confidence) {
+        if (confidence < best_confidence) {
+          continue;
+        }
+      }
+      else if (strongest[s] != strongest[best]) {
+        if (strongest[s] < strongest[best]) {
+          continue;
+        }
+      }
+      else if (d >= best_dist) {
+        continue;
+      }
     }
+    best = s;
+    best_dist = d;
+    frame_touched = true;
+    frame_touch.robot_id = r.robot_id;
+    frame_touch.time = times[s];
+    frame_touch.confidence = confidence;
+    frame_touch.methods = methods[s];
+  }
 
-    // fprintf(stderr, "---- %d\n", r.robot_id);
-    // for(int i = -5; i <= 0; i++)
-    //   fprintf(stderr, "%f %.0f,%.0f\n", hist[i].t, V2COMP(hist[i].v));
-
-    if (t - hist[-5].t > 15 * Constants::FramePeriod) {
-      continue;
-    }
+  if (frame_touched) {
+    since_touch = 0;
+    findContact(history, frame_touch.time, frame_touch);
+    touch = frame_touch;
+  }
+  return frame_touched;
+}
 
-    // check that the last three and three before that are in straight lines
-    if (!hist[-4].between(hist[-5], hist[-3]) || !hist[-1].between(hist[0], hist[-2])) {
-      continue;
+void TouchEngine::findContact(const WorldHistory &history, double estimate, Touch &touch)
+{
+  // the world nearest to the estimate, with the ball visible
+  int vertex = 0;
+  for (int i = 0; history.isValidIdx(i) && history.time(i) >= estimate - Constants::FramePeriod; i--) {
+    if (history.ball(i).visible()
+        && fabs(history.time(i) - estimate) < fabs(history.time(vertex) - estimate)) {
+      vertex = i;
     }
-
-    // check that they're not all in a straight line
-    if (cosine(hist[-5].v - hist[-3].v, hist[0].v - hist[-2].v) < -.99) {
-      continue;
+  }
+  touch.time = history.time(vertex);
+  touch.loc = history.ball(vertex).loc;
+
+  // the ball's locations on either side of it, up to CONTACT_SAMPLES each;
+  // the world nearest the touch is only fitted (as the start of the
+  // trajectory after) if there would otherwise be too few samples
+  LinearFit<CONTACT_SAMPLES> before, after;
+  int start = vertex;
+  for (int n = 0; n < CONTACT_SAMPLES && history.isValidIdx(start - 1);) {
+    start--;
+    n += history.ball(start).visible();
+  }
+  for (int i = start; i < vertex; i++) {
+    if (history.ball(i).visible()) {
+      before.add(history.time(i), history.ball(i).loc);
     }
+  }
 
-    vector2f inter = intersection(hist[-5].v, hist[-3].v, hist[-2].v, hist[0].v);
-
-    double t0 = point_on_segment_t(hist[-5].v, hist[-3].v, inter);
-    double t1 = point_on_segment_t(hist[0].v, hist[-2].v, inter);
-    if (t0 < .9 || t1 < .9) {
-      continue;
+  int end = std::min(0, vertex + CONTACT_SAMPLES);
+  int num_after = 0;
+  double t_after = 0;
+  for (int i = end; i > vertex; i--) {
+    if (history.ball(i).visible()) {
+      num_after++;
+      t_after = history.time(i);
     }
-
-    if (inter.length() < Constants::MaxRobotRadius + Constants::BallRadius + 30 && inter.length() < hist[-5].v.length()
-        && inter.length() < hist[0].v.length()) {
-      res.robot_id = r.robot_id;
-      res.time = t - 2 * Constants::FramePeriod;
-      found = true;
+  }
+  if (num_after == 0) {
+    return;
+  }
+  if (num_after < 2) {
+    after.add(touch.time, touch.loc);
+  }
+  for (int i = vertex + 1; i <= end; i++) {
+    if (history.ball(i).visible()) {
+      after.add(history.time(i), history.ball(i).loc);
     }
   }
+  if (before.size() < 2 || after.size() < 2) {
+    return;
+  }
 
-  if (found && last > 3) {
-    last = 0;
-    return true;
+  // the touch is when the two fitted trajectories come closest, somewhere
+  // between the last sample on the first and the first on the second
+  vector2f dp = before.position(touch.time) - after.position(touch.time);
+  vector2f dv = before.velocity() - after.velocity();
+  if (dv.sqlength() < 1) {
+    return;
   }
+  double s = bound(-dot(dp, dv) / dv.sqlength(), before[0].t - touch.time, t_after - touch.time);
 
-  return false;
+  touch.time += s;
+  touch.loc = (before.position(touch.time) + after.position(touch.time)) / 2;
 }
 
-bool BackTrackProcessor::proc(const World &w, CollideResult &res)
+float TouchEngine::scoreBackTrack(const Track &track, const Limits &limits, double &time)
 {
-  last++;
-  double t = w.time;
-  const WorldBall &ball = w.ball;
-
-  if (t0 == 0) {
-    t0 = t;
+  // extrapolate the ball's motion over the last VEL_SAMPLES samples backward
+  // to the two samples before them
+  SampleView hist = track.recent();
+
+  float radius = limits.backtrack_radius;
+  float closest = HUGE_VALF;
+  for (int i = -VEL_SAMPLES - 1; i < -VEL_SAMPLES + 1; i++) {
+    closest = std::min(closest, track.fit.position(hist[i].t).sqlength());
   }
-
-  if (ball.conf < .1) {
-    return false;
+  if (closest >= radius * radius) {
+    return 0;
   }
 
-  bool found = false;
-  for (const auto &r : w.robots) {
-    if (!r.visible()) {
-      continue;
-    }
-    vector2f v = ball.loc - r.loc;
-
-    RunningQueue<tvec, HIST_LEN> &hist = robot_history[r.robot_id.team][r.robot_id.id];
-    hist.add(tvec(t - t0, v));
-
-    // not enough samples yet; give up
-    if (hist.size() < HIST_LEN) {
-      continue;
+  // unless the ball passed "through" the robot before the last few samples
+  // (probably was chipped over); checked last, as it rarely matters
+  for (int i = -BACKTRACK_LEN + 1; i < -VEL_SAMPLES + 1; i++) {
+    if (distance_to_segment(hist[i].v, hist[i + 1].v, vector2f(0, 0)) < limits.through_radius) {
+      return 0;
     }
+  }
+  time = hist[-2].t;
+  return .5 + .5 * (1 - sqrtf(closest) / radius);
+}
 
-    // recent samples are too sparse; give up
-    if (t - (t0 + hist[-HIST_LEN + 1].t) > 3 * HIST_LEN * Constants::FramePeriod) {
-      continue;
-    }
+float TouchEngine::scoreRobotDist(const SampleView &hist, const Limits &limits, double &time)
+{
+  // the touch point is where the lines through them meet, so each line must
+  // pass close enough to the robot (which rules out most robots cheaply)
+  float radius = limits.robot_dist_radius;
+  if (!lineNearOrigin(hist[-5].v, hist[-3].v, radius) || !lineNearOrigin(hist[0].v, hist[-2].v, radius)) {
+    return 0;
+  }
 
-    // check whether ball passed "through" the robot before the last few
-    // samples (probably was chipped over)
-    bool through = false;
-    for (int i = -HIST_LEN + 1; i < -VEL_SAMPLES + 1; i++) {
-      double seg_dist = distance_to_segment(hist[i].v, hist[i + 1].v, vector2f(0, 0));
-      if (seg_dist < Constants::MaxRobotRadius - Constants::BallRadius) {
-        through = true;
-        break;
-      }
-    }
-    if (through) {
-      continue;
-    }
+  // check that the last three and three before that are in straight lines,
+  // but not all in one
+  if (!hist[-4].between(hist[-5], hist[-3]) || !hist[-1].between(hist[0], hist[-2])) {
+    return 0;
+  }
+  if (cosine(hist[-5].v - hist[-3].v, hist[0].v - hist[-2].v) < -.99) {
+    return 0;
+  }
 
-    // estimate velocity of ball from last VEL_SAMPLES samples and extrapolate
-    // backward before that
-    vector2f p0, v0;
-    linvel(hist, p0, v0, VEL_SAMPLES);
+  vector2f inter = intersection(hist[-5].v, hist[-3].v, hist[-2].v, hist[0].v);
+  if (point_on_segment_t(hist[-5].v, hist[-3].v, inter) < .9 || point_on_segment_t(hist[0].v, hist[-2].v, inter) < .9) {
+    return 0;
+  }
 
-    // printf("%.3f || p %.0f,%.0f || v %.3f,%.3f\n", t, V2COMP(p0), V2COMP(v0));
+  float len = inter.length();
+  if (len >= radius || len >= hist[-5].v.length() || len >= hist[0].v.length()) {
+    return 0;
+  }
+  time = hist[-2].t;
+  return .5 + .5 * (1 - len / radius);
+}
 
-    for (int i = -2; i < 0; i++) {
-      vector2f old_pos(p0 + i * Constants::FramePeriod * v0);
-      if (old_pos.length() < Constants::MaxRobotRadius + Constants::BallRadius - 10) {
-        res.robot_id = r.robot_id;
-        res.time = t - 2 * Constants::FramePeriod;
-        found = true;
+std::string TouchEngine::methodNames(uint32_t methods)
+{
+  static const char *const names[] = {"Accel", "BackTrack", "RobotDist"};
+  std::string s;
+  for (int i = 0; i < 3; i++) {
+    if (methods >> i & 1) {
+      if (!s.empty()) {
+        s += '+';
       }
+      s += names[i];
     }
   }
-
-  if (found && last > 3) {
-    last = 0;
-    return true;
-  }
-
-  return false;
+  return s;
 }
-
-// float AccelProcessor::BallNearDist  = Constants::MaxRobotRadius + Constants::BallRadius + 70.0;
-// float AccelProcessor::BallCloseDist = Constants::MaxRobotRadius + Constants::BallRadius + 40.0;
-// float AccelProcessor::BallLooseDist = 500.0;
-// float AccelProcessor::BallTouchAcceleration = 50000.0;
-
-// AccelProcessor::AccelProcessor(){
-
-// }
@@ -1,151 +1,168 @@
 #pragma once
 
+#include <cstdint>
+
+#include <string>
+
 #include "constants.h"
+#include "linear_fit.h"
 #include "shared/geomalgo.h"
-#include "shared/runqueue.h"
 #include "util.h"
 #include "world.h"
+#include "world_history.h"
 
-struct CollideResult
+// samples stored contiguously, oldest first, and indexed from the newest like
+// WorldHistory (0 is the newest, -size() + 1 the oldest)
+class SampleView
 {
+  const tvec *newest;
+  int num;
+
 public:
-  RobotID robot_id;
-  double time;
+  SampleView(const tvec *newest_, int num_) : newest(newest_), num(num_)
+  {
+  }
 
-  CollideResult() : time(0)
+  int size() const
   {
+    return num;
   }
-  CollideResult(RobotID id, double time) : robot_id(id), time(time)
+  const tvec &operator[](int i) const
   {
+    return newest[i];
   }
 };
 
-class TouchProcessor
-{
-public:
-  virtual bool proc(const World &w, CollideResult &res) = 0;
-  virtual const char *name() = 0;
-};
-
-class AccelProcessor : public TouchProcessor
+// Detects touches with the Accel, BackTrack and RobotDist methods (which
+// were separate processors) at once, from a history of the ball relative to each
+// robot that is added to once per frame. Each method that sees a robot
+// touch the ball scores it; the scores are fused into one confidence per
+// robot, and the robot with the highest confidence is blamed, so that no
+// method takes precedence over the others.
+class TouchEngine
 {
-  RunningQueue<World, 100> history;
-  int last;
-
 public:
-  AccelProcessor()
+  enum Method
   {
-    history.init();
-  }
+    ACCEL = 1,
+    BACKTRACK = 2,
+    ROBOT_DIST = 4,
+  };
 
-  bool proc(const World &w, CollideResult &res);
-  const char *name()
+  struct Touch
   {
-    return "AccelProcessor";
-  }
-};
+    RobotID robot_id;
 
-class LineCheckProcessor : public TouchProcessor
-{
-  RunningQueue<World, 100> history;
-  int last;
+    // when the touch was and where the ball was then, from where the
+    // ball's trajectories before and after it meet (or, if they cannot be
+    // fitted, the frame nearest the touch and the ball's location in it)
+    double time;
+    vector2f loc;
 
-  bool line3(World a, World b, World c)
-  {
-    return cosine(a.ball.loc - b.ball.loc, c.ball.loc - b.ball.loc) < -.95;
-    // double f = (b.timestamp - a.timestamp) / (c.timestamp - a.timestamp);
-    // vector2f v = (1 - f) * a.ball.loc - f * c.ball.loc;
-    // return dist(v, b.ball.loc) < 10;
-  }
+    // in (0, 1]; the Method bits of the methods that saw the touch
+    float confidence;
+    uint32_t methods;
 
-public:
-  LineCheckProcessor() : last(0)
-  {
-    history.init();
-  }
+    Touch() : time(0), loc(0, 0), confidence(0), methods(0)
+    {
+    }
+  };
 
-  bool proc(const World &w, CollideResult &res);
-  const char *name()
-  {
-    return "LineCheckProcessor";
-  }
-};
+  // how much a touch seen by each method alone, at its most certain, is
+  // trusted; an abrupt change in the ball's velocity is often just noise
+  static constexpr float AccelWeight = .6;
+  static constexpr float BackTrackWeight = .9;
+  static constexpr float RobotDistWeight = .8;
 
-class RobotDistProcessor : public TouchProcessor
-{
-  RunningQueue<tvec, 6> robot_history[NumTeams][MaxRobotIds];
+  // touches with a lower confidence are not reported (any one method
+  // seeing a touch is enough)
+  static constexpr float MinConfidence = .25;
 
-  int last;
+  // frames after a touch is reported during which no other is
+  static const int RefractoryFrames = 3;
 
-public:
-  RobotDistProcessor() : last(0)
+  TouchEngine()
   {
-    for (int t = 0; t < NumTeams; t++)
-      for (int r = 0; r < MaxRobotIds; r++) robot_history[t][r].init();
+    reset();
   }
 
-  bool proc(const World &w, CollideResult &res);
-  const char *name()
-  {
-    return "RobotDistProcessor";
-  }
-};
+  void reset();
 
-template <const int n>
-void linvel(RunningQueue<tvec, n> &vals, vector2f &p0, vector2f &v0, int samples = 0)
-{
-  if (samples == 0) samples = n;
-
-  double t0 = vals[-samples + 1].t;
-  double sxx = 0, sxy = 0, sx = 0, sy = 0;
-  double txx = 0, txy = 0, tx = 0, ty = 0;
-  for (int i = -samples + 1; i <= 0; i++) {
-    double t = vals[i].t - t0;
-    double x = vals[i].v.x;
-    double y = vals[i].v.y;
-
-    sxx += t * t;
-    sxy += t * x;
-    sx += t;
-    sy += x;
-
-    txx += t * t;
-    txy += t * y;
-    tx += t;
-    ty += y;
-  }
-  double vx = (samples * sxy - sx * sy) / (samples * sxx - sx * sx);
-  double vy = (samples * txy - tx * ty) / (samples * txx - tx * tx);
-  double cx = (sy - sx * vx) / samples;
-  double cy = (ty - tx * vy) / samples;
+  // adds history[0] to the per-robot histories and returns whether it shows
+  // a touch, in touch; called again on the same world, returns the same
+  bool update(const WorldHistory &history, Touch &touch);
 
-  p0.set(cx, cy);
-  v0.set(vx, vy);
-}
+  // the names of the methods in a Method mask, joined with '+'
+  static std::string methodNames(uint32_t methods);
 
-class BackTrackProcessor : public TouchProcessor
-{
+private:
   static const int VEL_SAMPLES = 4;
   static const int COMP_SAMPLES = 4;
-  static const int HIST_LEN = VEL_SAMPLES + COMP_SAMPLES;
-  float t0;
-  RunningQueue<tvec, HIST_LEN> robot_history[NumTeams][MaxRobotIds];
+  static const int BACKTRACK_LEN = VEL_SAMPLES + COMP_SAMPLES;
+  static const int ROBOT_DIST_LEN = 6;
+
+  // the ball relative to one robot over the frames where both were seen
+  // (and the ball had a confidence of at least .1). Each sample is stored
+  // twice, Size apart, so that the newest ones are always contiguous and
+  // the methods can read them in place.
+  struct Track
+  {
+    static const int Size = 16;
+    tvec samples[2 * Size];
 
-  int last;
+    // bit k set if the ball was visible in the sample k before the newest
+    uint32_t ball_visible;
 
-public:
-  BackTrackProcessor() : t0(0), last(0)
-  {
-    for (int t = 0; t < NumTeams; t++) {
-      for (int r = 0; r < MaxRobotIds; r++) {
-        robot_history[t][r].init();
+    // the ball's motion over the newest VEL_SAMPLES samples
+    LinearFit<VEL_SAMPLES> fit;
+
+    int newest, num;
+
+    void add(const tvec &s, bool visible)
+    {
+      newest = (newest + 1) % Size;
+      samples[newest] = samples[newest + Size] = s;
+      ball_visible = ball_visible << 1 | visible;
+      fit.add(s.t, s.v);
+      if (num < Size) {
+        num++;
       }
     }
-  }
 
-  bool proc(const World &w, CollideResult &res);
-  const char *name()
+    // the newest num samples
+    SampleView recent() const
+    {
+      return SampleView(&samples[newest + Size], num);
+    }
+  };
+
+  // the Constants that the methods use, read once per frame rather than
+  // once per robot (as thread_locals, each read has a cost)
+  struct Limits
   {
-    return "BackTrackProcessor";
-  }
+    double frame_period;
+    float backtrack_radius, through_radius, robot_dist_radius;
+  };
+
+  // the score (in [.5, 1], or 0 if it sees no touch) each method gives a
+  // robot from its track, or from the samples of it that the method uses;
+  // time is set to the method's estimate of when the touch was
+  static float scoreBackTrack(const Track &track, const Limits &limits, double &time);
+  static float scoreRobotDist(const SampleView &hist, const Limits &limits, double &time);
+
+  // the samples of the ball's location fitted on each side of a touch
+  static const int CONTACT_SAMPLES = 4;
+
+  // sets touch.time and touch.loc from a method's estimate of the time
+  static void findContact(const WorldHistory &history, double estimate, Touch &touch);
+
+  Track tracks[RobotSet::NumSlots];
+
+  // the time of the last world added, and what update returned for it
+  double frame_time;
+  bool frame_touched;
+  Touch frame_touch;
+
+  // frames added since the last touch was reported
+  int since_touch;
 };